@@ -0,0 +1,167 @@
+#include "adler32.h"
+#include "cpudispatch.h"
+
+#ifdef INFLATE_X86_DISPATCH
+#include <immintrin.h>
+#endif
+
+namespace {
+    const uint32_t base = 65521;  // largest prime smaller than 65536
+    const size_t nmax = 5552;     // most bytes before s2 may overflow
+
+    void sums_scalar(uint32_t& s1, uint32_t& s2,
+            const unsigned char* p, size_t len) {
+        while (len--) {
+            s1 += *p++;
+            s2 += s1;
+        }
+    }
+
+    typedef void (*Sums)(uint32_t& s1, uint32_t& s2,
+            const unsigned char* p, size_t len);
+
+#ifdef INFLATE_X86_DISPATCH
+    __attribute__((target("sse2")))
+    void sums_sse2(uint32_t& s1, uint32_t& s2,
+            const unsigned char* p, size_t len) {
+    /* Sums len (a multiple of 16, at most nmax) bytes 16 at a time.
+     * Byte j of a 16 byte chunk adds (16 - j) times itself to s2, and
+     * every byte adds 16 times itself to s2 per chunk that follows. */
+        const __m128i zero = _mm_setzero_si128();
+        const __m128i weights_lo = _mm_setr_epi16(16, 15, 14, 13, 12, 11, 10, 9);
+        const __m128i weights_hi = _mm_setr_epi16(8, 7, 6, 5, 4, 3, 2, 1);
+        __m128i vs1 = zero;         // byte sums
+        __m128i vs2 = zero;         // weighted byte sums
+        __m128i vprefix = zero;     // byte sums of all preceding chunks
+        size_t chunks = len / 16;
+
+        for (size_t i = 0; i < chunks; i++, p += 16) {
+            __m128i bytes = _mm_loadu_si128(
+                    reinterpret_cast<const __m128i*>(p));
+            vprefix = _mm_add_epi32(vprefix, vs1);
+            vs1 = _mm_add_epi32(vs1, _mm_sad_epu8(bytes, zero));
+            vs2 = _mm_add_epi32(vs2, _mm_madd_epi16(
+                        _mm_unpacklo_epi8(bytes, zero), weights_lo));
+            vs2 = _mm_add_epi32(vs2, _mm_madd_epi16(
+                        _mm_unpackhi_epi8(bytes, zero), weights_hi));
+        }
+
+        uint32_t lanes1[4], lanes2[4], lanesp[4];
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(lanes1), vs1);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(lanes2), vs2);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(lanesp), vprefix);
+
+        uint64_t sum1 = (uint64_t)lanes1[0] + lanes1[2];
+        uint64_t sum2 = (uint64_t)s2 + (uint64_t)s1 * len
+            + 16 * ((uint64_t)lanesp[0] + lanesp[2])
+            + lanes2[0] + lanes2[1] + lanes2[2] + lanes2[3];
+        s1 = (uint32_t)((s1 + sum1) % base);
+        s2 = (uint32_t)(sum2 % base);
+    }
+
+    __attribute__((target("avx2")))
+    void sums_avx2(uint32_t& s1, uint32_t& s2,
+            const unsigned char* p, size_t len) {
+    /* As sums_sse2, 32 bytes at a time, maddubs weighing the bytes and
+     * adding them in pairs, which madd widens to 32 bits */
+        const __m256i zero = _mm256_setzero_si256();
+        const __m256i weights = _mm256_setr_epi8(
+                32, 31, 30, 29, 28, 27, 26, 25, 24, 23, 22, 21, 20, 19, 18, 17,
+                16, 15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1);
+        const __m256i ones = _mm256_set1_epi16(1);
+        __m256i vs1 = zero;
+        __m256i vs2 = zero;
+        __m256i vprefix = zero;
+        size_t chunks = len / 32;
+
+        for (size_t i = 0; i < chunks; i++, p += 32) {
+            __m256i bytes = _mm256_loadu_si256(
+                    reinterpret_cast<const __m256i*>(p));
+            vprefix = _mm256_add_epi32(vprefix, vs1);
+            vs1 = _mm256_add_epi32(vs1, _mm256_sad_epu8(bytes, zero));
+            vs2 = _mm256_add_epi32(vs2, _mm256_madd_epi16(
+                        _mm256_maddubs_epi16(bytes, weights), ones));
+        }
+
+        uint32_t lanes1[8], lanes2[8], lanesp[8];
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(lanes1), vs1);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(lanes2), vs2);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(lanesp), vprefix);
+
+        uint64_t sum1 = 0, prefix = 0, sum2 = 0;
+        for (int i = 0; i < 8; i += 2) {
+            sum1 += lanes1[i];
+            prefix += lanesp[i];
+        }
+        for (int i = 0; i < 8; i++) {
+            sum2 += lanes2[i];
+        }
+        sum2 += (uint64_t)s2 + (uint64_t)s1 * len + 32 * prefix;
+        s1 = (uint32_t)((s1 + sum1) % base);
+        s2 = (uint32_t)(sum2 % base);
+    }
+#endif
+
+    uint32_t adler32_with(uint32_t adler, const char* data, size_t len,
+            Sums vector_sums, size_t width) {
+    /* Takes the input nmax bytes at a time, reducing in between, the
+     * vector sums taking the multiple of width bytes of each */
+        uint32_t s1 = adler & 0xffff;
+        uint32_t s2 = adler >> 16;
+        const unsigned char* p =
+            reinterpret_cast<const unsigned char*>(data);
+
+        while (len > 0) {
+            size_t n = len < nmax ? len : nmax;
+            len -= n;
+            size_t vector_bytes = n / width * width;
+            if (vector_bytes > 0) {
+                vector_sums(s1, s2, p, vector_bytes);
+                p += vector_bytes;
+                n -= vector_bytes;
+            }
+            sums_scalar(s1, s2, p, n);
+            p += n;
+            s1 %= base;
+            s2 %= base;
+        }
+        return (s2 << 16) | s1;
+    }
+}
+
+
+uint32_t inflate::adler32_scalar(uint32_t adler, const char* data,
+        size_t len) {
+    return adler32_with(adler, data, len, sums_scalar, 1);
+}
+
+#ifdef INFLATE_X86_DISPATCH
+uint32_t inflate::adler32_sse2(uint32_t adler, const char* data,
+        size_t len) {
+    return adler32_with(adler, data, len, sums_sse2, 16);
+}
+
+uint32_t inflate::adler32_avx2(uint32_t adler, const char* data,
+        size_t len) {
+    return adler32_with(adler, data, len, sums_avx2, 32);
+}
+#endif
+
+
+namespace {
+    typedef uint32_t (*Checksum)(uint32_t, const char*, size_t);
+
+    Checksum select_adler32() {
+#ifdef INFLATE_X86_DISPATCH
+        inflate::cpu_tier tier = inflate::cpu_selected();
+        if (tier >= inflate::cpu_tier::avx2) return inflate::adler32_avx2;
+        if (tier >= inflate::cpu_tier::sse2) return inflate::adler32_sse2;
+#endif
+        return inflate::adler32_scalar;
+    }
+}
+
+uint32_t inflate::adler32(uint32_t adler, const char* data, size_t len) {
+    static const Checksum kernel = select_adler32();
+    return kernel(adler, data, len);
+}
@@ -0,0 +1,33 @@
+#ifndef ADLER32_H
+#define ADLER32_H
+
+#include <cstddef>
+#include <cstdint>
+
+#include "checksumbuf.h"
+#include "cpudispatch.h"
+
+namespace inflate {
+    /* Updates a running Adler-32 checksum (RFC 1950 8.2) with len bytes,
+     * start with adler = 1. Selected on the first call, by cpu_selected(),
+     * from AVX2, SSE2 and scalar implementations. */
+    uint32_t adler32(uint32_t adler, const char* data, size_t len);
+
+    // The implementations, for testing and benchmarking
+    uint32_t adler32_scalar(uint32_t adler, const char* data, size_t len);
+#ifdef INFLATE_X86_DISPATCH
+    uint32_t adler32_sse2(uint32_t adler, const char* data, size_t len);
+    uint32_t adler32_avx2(uint32_t adler, const char* data, size_t len);
+#endif
+
+    class adler32stream;
+}
+
+
+class inflate::adler32stream : public checksumstream<inflate::adler32> {
+public:
+    adler32stream(uint32_t adler=1)
+        : checksumstream<inflate::adler32>(adler) {}
+};
+
+#endif
@@ -0,0 +1,311 @@
+#include "asyncreader.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <unistd.h>
+
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#define INFLATE_IO_URING
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#endif
+#endif
+
+namespace {
+    // pread, through interruptions
+    ssize_t read_at(int fd, char* s, size_t count, uint64_t offset) noexcept {
+        ssize_t got;
+        do {
+            got = pread(fd, s, count, offset);
+        } while (got < 0 && errno == EINTR);
+        return got;
+    }
+}
+
+
+#ifdef INFLATE_IO_URING
+/* Just enough of io_uring for reads, through the system calls themselves
+ * rather than liburing: one mapping for both rings, as kernels since 5.4
+ * give, and IORING_OP_READ, from 5.6. */
+struct asyncreader::uring {
+    int fd = -1;
+    void* rings = MAP_FAILED;
+    size_t rings_size = 0;
+    io_uring_sqe* sqes = static_cast<io_uring_sqe*>(MAP_FAILED);
+    size_t sqes_size = 0;
+    unsigned* sq_tail;
+    unsigned* sq_mask;
+    unsigned* sq_array;
+    unsigned* cq_head;
+    unsigned* cq_tail;
+    unsigned* cq_mask;
+    io_uring_cqe* cqes;
+
+    bool setup(unsigned entries) noexcept {
+        io_uring_params p;
+        std::memset(&p, 0, sizeof(p));
+        fd = syscall(__NR_io_uring_setup, entries, &p);
+        if (fd < 0) return false;
+        if (!(p.features & IORING_FEAT_SINGLE_MMAP)
+                || !(p.features & IORING_FEAT_RW_CUR_POS)) {
+            return false;   // too old to have IORING_OP_READ
+        }
+        rings_size = std::max<size_t>(
+                p.sq_off.array + p.sq_entries * sizeof(unsigned),
+                p.cq_off.cqes + p.cq_entries * sizeof(io_uring_cqe));
+        rings = mmap(nullptr, rings_size, PROT_READ|PROT_WRITE,
+                MAP_SHARED|MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+        sqes_size = p.sq_entries * sizeof(io_uring_sqe);
+        sqes = static_cast<io_uring_sqe*>(mmap(nullptr, sqes_size,
+                PROT_READ|PROT_WRITE, MAP_SHARED|MAP_POPULATE, fd,
+                IORING_OFF_SQES));
+        if (rings == MAP_FAILED || sqes == MAP_FAILED) return false;
+
+        char* base = static_cast<char*>(rings);
+        sq_tail = reinterpret_cast<unsigned*>(base + p.sq_off.tail);
+        sq_mask = reinterpret_cast<unsigned*>(base + p.sq_off.ring_mask);
+        sq_array = reinterpret_cast<unsigned*>(base + p.sq_off.array);
+        cq_head = reinterpret_cast<unsigned*>(base + p.cq_off.head);
+        cq_tail = reinterpret_cast<unsigned*>(base + p.cq_off.tail);
+        cq_mask = reinterpret_cast<unsigned*>(base + p.cq_off.ring_mask);
+        cqes = reinterpret_cast<io_uring_cqe*>(base + p.cq_off.cqes);
+        return true;
+    }
+
+    ~uring() {
+        if (sqes != MAP_FAILED) munmap(sqes, sqes_size);
+        if (rings != MAP_FAILED) munmap(rings, rings_size);
+        if (fd >= 0) close(fd);
+    }
+
+    // whether the kernel took the read
+    bool submit(int file, char* s, unsigned count, uint64_t offset,
+            uint64_t tag) noexcept {
+        unsigned tail = *sq_tail;   // only ever written here
+        unsigned index = tail & *sq_mask;
+        io_uring_sqe& sqe = sqes[index];
+        std::memset(&sqe, 0, sizeof(sqe));
+        sqe.opcode = IORING_OP_READ;
+        sqe.fd = file;
+        sqe.addr = reinterpret_cast<uint64_t>(s);
+        sqe.len = count;
+        sqe.off = offset;
+        sqe.user_data = tag;
+        sq_array[index] = index;
+        __atomic_store_n(sq_tail, tail + 1, __ATOMIC_RELEASE);
+        int taken;
+        do {
+            taken = syscall(__NR_io_uring_enter, fd, 1, 0, 0, nullptr, 0);
+        } while (taken < 0 && errno == EINTR);
+        if (taken == 1) return true;
+        // not consumed, so the next call would submit it again
+        __atomic_store_n(sq_tail, tail, __ATOMIC_RELEASE);
+        return false;
+    }
+
+    // the next completion, waiting for one if there is none yet
+    bool reap(uint64_t& tag, int& result) noexcept {
+        for (;;) {
+            unsigned head = *cq_head;
+            if (head != __atomic_load_n(cq_tail, __ATOMIC_ACQUIRE)) {
+                const io_uring_cqe& cqe = cqes[head & *cq_mask];
+                tag = cqe.user_data;
+                result = cqe.res;
+                __atomic_store_n(cq_head, head + 1, __ATOMIC_RELEASE);
+                return true;
+            }
+            if (syscall(__NR_io_uring_enter, fd, 0, 1,
+                    IORING_ENTER_GETEVENTS, nullptr, 0) < 0
+                    && errno != EINTR && errno != EAGAIN && errno != EBUSY) {
+                return false;
+            }
+        }
+    }
+};
+#else
+struct asyncreader::uring {
+    bool setup(unsigned) noexcept {return false;}
+    bool submit(int, char*, unsigned, uint64_t, uint64_t) noexcept
+        {return false;}
+    bool reap(uint64_t&, int&) noexcept {return false;}
+};
+#endif
+
+
+asyncreader::asyncreader(int fd, int depth/*=4*/,
+        size_t block_size/*=default_block_size*/,
+        bool use_io_uring/*=true*/)
+    : fd(fd)
+    , block_size(std::max<size_t>(block_size, 4096))
+    , slots(std::max(depth, 1))
+    , current(0)
+    , handed(false)
+    , finished(false)
+    , next_offset(0)
+    , err(0)
+    , stopping(false) {
+    for (slot& s : slots) {
+        s.data.resize(this->block_size);
+        s.queued = s.done = false;
+    }
+    if (use_io_uring) {
+        ring.reset(new uring());
+        if (!ring->setup(slots.size())) ring.reset();
+    }
+    if (!ring) {
+        worker = std::thread(&asyncreader::work, this);
+    }
+    restart(0);
+}
+
+asyncreader::~asyncreader() {
+    // the kernel or the thread may still be writing into the blocks
+    drain();
+    if (worker.joinable()) {
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            stopping = true;
+        }
+        changed.notify_all();
+        worker.join();
+    }
+}
+
+size_t asyncreader::next(const char*& data) noexcept {
+/* The block handed over last time is read again further on, and the one
+ * after it waited for: all the others stay in flight meanwhile */
+    int depth = slots.size();
+    if (handed) {
+        int last = (current + depth - 1) % depth;
+        slots[last].offset = next_offset;
+        next_offset += block_size;
+        queue(last);
+        handed = false;
+    }
+    if (finished || err) return 0;
+
+    slot& s = slots[current];
+    wait(current);
+    if (s.result < 0) {
+        err = -s.result;
+        return 0;
+    }
+    // reads may come up short before the end, on some file systems
+    s.size = s.result;
+    while (s.size > 0 && s.size < block_size) {
+        ssize_t got = read_at(fd, s.data.data() + s.size,
+                block_size - s.size, s.offset + s.size);
+        if (got < 0) {
+            err = errno;
+            return 0;
+        }
+        if (got == 0) break;
+        s.size += got;
+    }
+    if (s.size < block_size) finished = true;
+    if (s.size == 0) return 0;
+
+    current = (current + 1) % depth;
+    handed = true;
+    data = s.data.data();
+    return s.size;
+}
+
+void asyncreader::seek(uint64_t offset) noexcept {
+    drain();
+    restart(offset);
+}
+
+void asyncreader::restart(uint64_t offset) noexcept {
+    next_offset = offset;
+    current = 0;
+    handed = false;
+    finished = false;
+    err = 0;
+    for (size_t i = 0; i < slots.size(); i++) {
+        slots[i].offset = next_offset;
+        next_offset += block_size;
+        queue(i);
+    }
+}
+
+void asyncreader::queue(int i) noexcept {
+    slot& s = slots[i];
+    s.queued = true;
+    if (ring || !worker.joinable()) {
+        s.done = false;
+        if (!ring
+                || !ring->submit(fd, s.data.data(), block_size, s.offset, i)) {
+            s.result = read_at(fd, s.data.data(), block_size, s.offset);
+            if (s.result < 0) s.result = -errno;
+            s.done = true;
+        }
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        s.done = false;
+        pending.push_back(i);
+    }
+    changed.notify_all();
+}
+
+void asyncreader::wait(int i) noexcept {
+    slot& s = slots[i];
+    if (!s.queued) return;
+    s.queued = false;
+    if (ring) {
+        // completions come in any order, each one for the slot it names
+        while (!s.done) {
+            uint64_t tag;
+            int result;
+            if (!ring->reap(tag, result)) {
+                drop_ring();
+                break;
+            }
+            slots[tag].result = result;
+            slots[tag].done = true;
+        }
+        return;
+    }
+    std::unique_lock<std::mutex> guard(lock);
+    changed.wait(guard, [&] {return s.done;});
+}
+
+void asyncreader::drain() noexcept {
+    for (size_t i = 0; i < slots.size(); i++) {
+        wait(i);
+    }
+}
+
+void asyncreader::drop_ring() noexcept {
+/* Closing the ring cancels the reads still in flight, before their blocks
+ * can be freed, and those are read here instead, as all later ones are */
+    ring.reset();
+    for (slot& s : slots) {
+        if (s.done) continue;
+        s.result = read_at(fd, s.data.data(), block_size, s.offset);
+        if (s.result < 0) s.result = -errno;
+        s.done = true;
+    }
+}
+
+void asyncreader::work() noexcept {
+    std::unique_lock<std::mutex> guard(lock);
+    for (;;) {
+        changed.wait(guard, [&] {return stopping || !pending.empty();});
+        if (stopping) return;
+        slot& s = slots[pending.front()];
+        pending.pop_front();
+        guard.unlock();
+        int result = read_at(fd, s.data.data(), block_size, s.offset);
+        if (result < 0) result = -errno;
+        guard.lock();
+        s.result = result;
+        s.done = true;
+        changed.notify_all();
+    }
+}
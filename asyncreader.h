@@ -0,0 +1,81 @@
+#ifndef ASYNCREADER_H
+#define ASYNCREADER_H
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Reads a file ahead of its reader, with depth reads of block_size bytes
+// in flight at once: through io_uring where the kernel allows it, else on
+// a thread of its own issuing preads. Blocks are handed over in file
+// order, so a reader only ever waits on the one it wants next, while the
+// reads after it carry on. Meant for storage with long latencies, such as
+// network block devices, where one synchronous read at a time leaves the
+// decoder idle for most of each read.
+class asyncreader {
+public:
+    static const size_t default_block_size = 1 << 20;
+
+    /* Starts reading fd from the start. fd stays the caller's, and must
+     * outlive this. With use_io_uring false, always reads on a thread. */
+    asyncreader(int fd, int depth=4,
+            size_t block_size=default_block_size, bool use_io_uring=true);
+    ~asyncreader();
+    asyncreader(const asyncreader&) = delete;
+    asyncreader& operator=(const asyncreader&) = delete;
+
+    /* Points data at the next block and returns its size, 0 at the end of
+     * the file or if reading failed. Valid until the next call. */
+    size_t next(const char*& data) noexcept;
+    // drops what was read ahead and starts again at offset
+    void seek(uint64_t offset) noexcept;
+    inline bool failed() const noexcept {return err != 0;}
+    // the errno of the read that failed, 0 if none has
+    inline int error() const noexcept {return err;}
+    inline bool uses_io_uring() const noexcept {return ring != nullptr;}
+    inline size_t memory() const noexcept
+        {return sizeof(*this) + slots.size() * block_size;}
+
+private:
+    struct slot {
+        std::vector<char> data;
+        uint64_t offset;
+        size_t size;
+        int result;     // bytes read, or -errno
+        bool queued;    // read, or being read, and not yet waited for
+        bool done;
+    };
+    struct uring;
+
+    void restart(uint64_t offset) noexcept;
+    void queue(int i) noexcept;
+    void wait(int i) noexcept;
+    void drain() noexcept;
+    void drop_ring() noexcept;
+    void work() noexcept;
+
+    int fd;
+    size_t block_size;
+    std::vector<slot> slots;
+    int current;            // the slot next hands over next
+    bool handed;            // the one before it is still the reader's
+    bool finished;          // a block came up short, at the end of the file
+    uint64_t next_offset;   // of the next block to queue
+    int err;
+
+    std::unique_ptr<uring> ring;
+
+    // the pread thread, when there is no ring
+    std::thread worker;
+    std::mutex lock;
+    std::condition_variable changed;
+    std::deque<int> pending;
+    bool stopping;
+};
+
+#endif
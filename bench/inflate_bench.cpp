@@ -0,0 +1,63 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include "../inflate.h"
+#include "../cpudispatch.h"
+
+// Decodes each gzip file given, checking its CRC-32 as gzip -t does, and
+// reports the best of a number of rounds. Also what trains profile-guided
+// builds, so it should exercise what users of the library do most.
+int main(int argc, char** argv) {
+    int rounds = 5;
+    int read_ahead = 0;
+    int first = 1;
+    for (; first + 1 < argc; first += 2) {
+        std::string arg = argv[first];
+        if (arg == "-n") {
+            rounds = std::max(1, std::atoi(argv[first + 1]));
+        }
+        else if (arg == "-a") {
+            read_ahead = std::atoi(argv[first + 1]);
+        }
+        else break;
+    }
+    if (first >= argc) {
+        std::cerr << "usage: " << argv[0] << " [-n rounds] [-a depth] file..."
+            << std::endl;
+        return 1;
+    }
+
+    // INFLATE_CPU picks the kernels, to compare them
+    std::cout << "kernels: " << inflate::cpu_tier_name(inflate::cpu_selected())
+        << std::endl;
+    uint64_t total_size = 0;
+    double total_time = 0;
+    for (int i = first; i < argc; i++) {
+        double best = 0;
+        inflate::verification v;
+        for (int round = 0; round < rounds; round++) {
+            auto start = std::chrono::steady_clock::now();
+            v = inflate::gunzip_verify(argv[i], 0, read_ahead);
+            std::chrono::duration<double> elapsed =
+                std::chrono::steady_clock::now() - start;
+            if (v.status) {
+                std::cerr << argv[i] << ": "
+                    << inflate::describe(v.status.code) << std::endl;
+                return 1;
+            }
+            if (round == 0 || elapsed.count() < best) {
+                best = elapsed.count();
+            }
+        }
+        best = std::max(best, 1e-9);
+        std::cout << argv[i] << ": " << v.uncompressed_size << " bytes, "
+            << v.uncompressed_size / 1e6 / best << " MB/s" << std::endl;
+        total_size += v.uncompressed_size;
+        total_time += best;
+    }
+    std::cout << "total: " << total_size << " bytes, "
+        << total_size / 1e6 / total_time << " MB/s" << std::endl;
+    return 0;
+}
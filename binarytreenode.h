@@ -1,7 +1,9 @@
 #ifndef BINARYTREENODE_H
 #define BINARYTREENODE_H
 
+#include <cstdlib>
 #include <functional>
+#include <sstream>
 #include <string>
 
 // Serialize a general binary tree with preorder traversal
@@ -39,7 +41,11 @@ treetype* deserialize(
     std::string symbol;
     while(datain >> symbol) {
         if (openpoints.empty()) {
+#if defined(__cpp_exceptions) || defined(__EXCEPTIONS)
             throw std::invalid_argument("Corrupted data: " + data);
+#else
+            std::abort();
+#endif
         }
         auto& curr = openpoints.back().get();
         openpoints.pop_back();
@@ -0,0 +1,161 @@
+#include "bytesearch.h"
+#include "cpudispatch.h"
+
+#include <cstdint>
+#include <cstring>
+
+#ifdef INFLATE_X86_DISPATCH
+#include <immintrin.h>
+#endif
+
+
+const char* inflate::find_byte_scalar(const char* first, const char* last,
+        char c) {
+    // eight bytes at a time, testing for a zero byte in word ^ pattern
+    const uint64_t ones = 0x0101010101010101ull;
+    const uint64_t pattern = ones * (unsigned char)c;
+    for (; last - first >= 8; first += 8) {
+        uint64_t word;
+        std::memcpy(&word, first, 8);
+        word ^= pattern;
+        if ((word - ones) & ~word & (ones << 7)) break;
+    }
+    for (; first < last; first++) {
+        if (*first == c) return first;
+    }
+    return last;
+}
+
+const char* inflate::find_string_scalar(const char* first, const char* last,
+        const char* pattern, size_t length) {
+    if (length == 0) return first;
+    if ((size_t)(last - first) < length) return last;
+    const char* final = last - length + 1;  // the last place it can start
+    while ((first = find_byte_scalar(first, final, pattern[0])) != final) {
+        if (std::memcmp(first + 1, pattern + 1, length - 1) == 0) {
+            return first;
+        }
+        first++;
+    }
+    return last;
+}
+
+#ifdef INFLATE_X86_DISPATCH
+__attribute__((target("sse2")))
+const char* inflate::find_byte_sse2(const char* first, const char* last,
+        char c) {
+    __m128i pattern = _mm_set1_epi8(c);
+    for (; last - first >= 16; first += 16) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(first));
+        int mask = _mm_movemask_epi8(_mm_cmpeq_epi8(v, pattern));
+        if (mask) return first + __builtin_ctz(mask);
+    }
+    return find_byte_scalar(first, last, c);
+}
+
+__attribute__((target("avx2")))
+const char* inflate::find_byte_avx2(const char* first, const char* last,
+        char c) {
+    __m256i pattern = _mm256_set1_epi8(c);
+    for (; last - first >= 32; first += 32) {
+        __m256i v = _mm256_loadu_si256(
+                reinterpret_cast<const __m256i*>(first));
+        unsigned mask = _mm256_movemask_epi8(_mm256_cmpeq_epi8(v, pattern));
+        if (mask) return first + __builtin_ctz(mask);
+    }
+    return find_byte_sse2(first, last, c);
+}
+
+__attribute__((target("sse2")))
+const char* inflate::find_string_sse2(const char* first, const char* last,
+        const char* pattern, size_t length) {
+    if (length < 2) {
+        if (length == 0) return first;
+        return find_byte_sse2(first, last, pattern[0]);
+    }
+    __m128i head = _mm_set1_epi8(pattern[0]);
+    __m128i tail = _mm_set1_epi8(pattern[length - 1]);
+    for (; (size_t)(last - first) >= length - 1 + 16; first += 16) {
+        __m128i starts = _mm_loadu_si128(
+                reinterpret_cast<const __m128i*>(first));
+        __m128i ends = _mm_loadu_si128(
+                reinterpret_cast<const __m128i*>(first + length - 1));
+        unsigned mask = _mm_movemask_epi8(_mm_and_si128(
+                    _mm_cmpeq_epi8(starts, head), _mm_cmpeq_epi8(ends, tail)));
+        while (mask) {
+            int i = __builtin_ctz(mask);
+            if (std::memcmp(first + i + 1, pattern + 1, length - 2) == 0) {
+                return first + i;
+            }
+            mask &= mask - 1;
+        }
+    }
+    return find_string_scalar(first, last, pattern, length);
+}
+
+__attribute__((target("avx2")))
+const char* inflate::find_string_avx2(const char* first, const char* last,
+        const char* pattern, size_t length) {
+    if (length < 2) {
+        if (length == 0) return first;
+        return find_byte_avx2(first, last, pattern[0]);
+    }
+    __m256i head = _mm256_set1_epi8(pattern[0]);
+    __m256i tail = _mm256_set1_epi8(pattern[length - 1]);
+    for (; (size_t)(last - first) >= length - 1 + 32; first += 32) {
+        __m256i starts = _mm256_loadu_si256(
+                reinterpret_cast<const __m256i*>(first));
+        __m256i ends = _mm256_loadu_si256(
+                reinterpret_cast<const __m256i*>(first + length - 1));
+        unsigned mask = _mm256_movemask_epi8(_mm256_and_si256(
+                    _mm256_cmpeq_epi8(starts, head),
+                    _mm256_cmpeq_epi8(ends, tail)));
+        while (mask) {
+            int i = __builtin_ctz(mask);
+            if (std::memcmp(first + i + 1, pattern + 1, length - 2) == 0) {
+                return first + i;
+            }
+            mask &= mask - 1;
+        }
+    }
+    return find_string_sse2(first, last, pattern, length);
+}
+#endif
+
+
+namespace {
+    typedef const char* (*Search)(const char*, const char*, char);
+
+    Search select_find_byte() {
+#ifdef INFLATE_X86_DISPATCH
+        inflate::cpu_tier tier = inflate::cpu_selected();
+        if (tier >= inflate::cpu_tier::avx2) return inflate::find_byte_avx2;
+        if (tier >= inflate::cpu_tier::sse2) return inflate::find_byte_sse2;
+#endif
+        return inflate::find_byte_scalar;
+    }
+
+    typedef const char* (*StringSearch)(const char*, const char*,
+            const char*, size_t);
+
+    StringSearch select_find_string() {
+#ifdef INFLATE_X86_DISPATCH
+        inflate::cpu_tier tier = inflate::cpu_selected();
+        if (tier >= inflate::cpu_tier::avx2) return inflate::find_string_avx2;
+        if (tier >= inflate::cpu_tier::sse2) return inflate::find_string_sse2;
+#endif
+        return inflate::find_string_scalar;
+    }
+}
+
+const char* inflate::find_byte(const char* first, const char* last,
+        char c) {
+    static const Search kernel = select_find_byte();
+    return kernel(first, last, c);
+}
+
+const char* inflate::find_string(const char* first, const char* last,
+        const char* pattern, size_t length) {
+    static const StringSearch kernel = select_find_string();
+    return kernel(first, last, pattern, length);
+}
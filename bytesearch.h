@@ -0,0 +1,36 @@
+#ifndef BYTESEARCH_H
+#define BYTESEARCH_H
+
+#include <cstddef>
+
+#include "cpudispatch.h"
+
+namespace inflate {
+    /* Returns the first c in [first, last), or last if there is none.
+     * Selected on the first call, by cpu_selected(), from AVX2, SSE2 and
+     * scalar implementations, as copy_match is. */
+    const char* find_byte(const char* first, const char* last, char c);
+
+    /* Returns the start of the first occurrence of the length bytes at
+     * pattern within [first, last), or last if there is none. The vector
+     * versions compare the first and last bytes of the pattern at every
+     * position at once, and only compare the rest where both match. */
+    const char* find_string(const char* first, const char* last,
+            const char* pattern, size_t length);
+
+    // The implementations, for testing and benchmarking
+    const char* find_byte_scalar(const char* first, const char* last,
+            char c);
+    const char* find_string_scalar(const char* first, const char* last,
+            const char* pattern, size_t length);
+#ifdef INFLATE_X86_DISPATCH
+    const char* find_byte_sse2(const char* first, const char* last, char c);
+    const char* find_byte_avx2(const char* first, const char* last, char c);
+    const char* find_string_sse2(const char* first, const char* last,
+            const char* pattern, size_t length);
+    const char* find_string_avx2(const char* first, const char* last,
+            const char* pattern, size_t length);
+#endif
+}
+
+#endif
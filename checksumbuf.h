@@ -0,0 +1,62 @@
+#ifndef CHECKSUMBUF_H
+#define CHECKSUMBUF_H
+
+#include <cstddef>
+#include <cstdint>
+#include <streambuf>
+#include <ostream>
+
+// A sink that discards its input, keeping only a running checksum of it.
+// Characters are collected in a small put area and summed in bulk by
+// update, e.g. inflate::adler32 or inflate::crc32.
+template <uint32_t (*update)(uint32_t, const char*, size_t)>
+class checksumbuf : public std::streambuf {
+public:
+    checksumbuf(uint32_t initial)
+        : value(initial) {
+        setp(block, block + sizeof(block));
+    }
+
+    inline uint32_t checksum() {sync(); return value;}
+
+private:
+    virtual int overflow(int c) {
+        sync();
+        if (c != EOF) {
+            *pptr() = (char)c;
+            pbump(1);
+        }
+        return c == EOF ? !EOF : c;
+    }
+
+    virtual int sync() {
+        value = update(value, pbase(), pptr() - pbase());
+        setp(block, block + sizeof(block));
+        return 0;
+    }
+
+    virtual std::streamsize xsputn(const char* s, std::streamsize n) {
+        sync();
+        value = update(value, s, n);
+        return n;
+    }
+
+    uint32_t value;
+    char block[4096];
+};
+
+
+template <uint32_t (*update)(uint32_t, const char*, size_t)>
+class checksumstream : public std::ostream {
+public:
+    checksumstream(uint32_t initial)
+        : std::ostream(&cbuf)
+        , cbuf(initial) {}
+
+    inline uint32_t checksum() {return cbuf.checksum();}
+
+private:
+    checksumbuf<update> cbuf;
+};
+
+#endif
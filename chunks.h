@@ -0,0 +1,153 @@
+#ifndef CHUNKS_H
+#define CHUNKS_H
+
+// C++20, unlike the rest of the library, which it only uses
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <span>
+#include <string>
+#include <vector>
+
+#include "crc32.h"
+#include "generator.h"
+#include "inflate.h"
+#include "inflater.h"
+
+namespace inflate {
+    /* The decoded data of every member of a gzip file, as chunks of up
+     * to chunk_size bytes, each valid until the next is asked for:
+     *     for (std::span<const std::byte> chunk : inflate::chunks(fn))
+     * Decoding runs only as far as the chunk asked for. Each member's
+     * CRC-32 is checked at its end. Throws as gunzip does. */
+    generator<std::span<const std::byte>> chunks(std::string fn,
+            size_t chunk_size=65536);
+
+    /* The same from a source that is read asynchronously, for callers
+     * that are coroutines themselves:
+     *     auto data = inflate::chunks(source);
+     *     while (auto chunk = co_await data.next()) ...
+     * source.read(std::span<std::byte>) must return an awaitable whose
+     * result is the number of bytes it read into the span, 0 at the end
+     * of the input. Decoding waits on it when input runs short, and the
+     * consumer with it, without holding a thread meanwhile. */
+    template <class Source>
+        requires requires(Source& s, std::span<std::byte> b) {s.read(b);}
+    async_generator<std::span<const std::byte>> chunks(Source& source,
+            size_t chunk_size=65536);
+}
+
+
+inline inflate::generator<std::span<const std::byte>> inflate::chunks(
+        std::string fn, size_t chunk_size/*=65536*/) {
+    ifbstream in(fn);
+    if (!in.is_open()) {
+        inflate::raise({inflate::error::cannot_open, 0});
+    }
+    ringbuffer buf(inflate::max_buffer_size);
+    std::vector<char> out(chunk_size);
+    do {
+        inflate::gzip_file file;
+        inflate::error e = inflate::_UTIL::read_gzip_header(in, file);
+        if (e != inflate::error::none) {
+            inflate::raise({e, in.tellbit()});
+        }
+        buf.reset();
+        inflate::inflater inf(in, buf);
+        uint32_t crc = 0;
+        uint64_t size = 0;
+        size_t count;
+        while ((count = inf.read(out.data(), out.size())) > 0) {
+            crc = inflate::crc32(crc, out.data(), count);
+            size += count;
+            co_yield std::span<const std::byte>(
+                    reinterpret_cast<const std::byte*>(out.data()), count);
+        }
+        e = inflate::_UTIL::check_gzip_trailer(in, crc, size);
+        if (e != inflate::error::none) {
+            inflate::raise({e, in.tellbit()});
+        }
+    } while (!in.at_end());
+}
+
+
+template <class Source>
+    requires requires(Source& s, std::span<std::byte> b) {s.read(b);}
+inflate::async_generator<std::span<const std::byte>> inflate::chunks(
+        Source& source, size_t chunk_size/*=65536*/) {
+/* The bit reader is fed from source until it holds what the next step
+ * needs: a whole gzip header, read again from the start while it runs
+ * past what there is, enough input that a chunk cannot run out of it
+ * mid-block, see inflater::set_lookahead, and the 8 bytes of a trailer.
+ * Only at the end of the input does running out mean it is truncated. */
+    const size_t read_size = 65536;
+    const size_t lookahead = 2 * chunk_size + 2048;
+    ifbstream in;
+    ringbuffer buf(inflate::max_buffer_size);
+    std::vector<char> out(chunk_size);
+    std::optional<inflate::inflater> inf;
+    enum {header, data, trailer} stage = header;
+    bool first = true;
+    bool ended = false;
+    size_t wanted = 1;  // bytes buffered before the next step
+    uint32_t crc = 0;
+    uint64_t size = 0;
+
+    while (true) {
+        while (!ended && in.buffered() < wanted) {
+            char* space = in.reserve_input(read_size);
+            size_t got = co_await source.read(std::span<std::byte>(
+                        reinterpret_cast<std::byte*>(space), read_size));
+            in.commit_input(got);
+            ended = got == 0;
+        }
+
+        if (stage == header) {
+            if (!first && in.at_end()) co_return;
+            uint64_t start = in.tellbit();
+            inflate::gzip_file file;
+            inflate::error e = inflate::_UTIL::read_gzip_header(in, file);
+            if (e == inflate::error::truncated && !ended) {
+                in.seekbit(start);
+                wanted = in.buffered() + 1;
+                continue;
+            }
+            if (e != inflate::error::none) {
+                inflate::raise({e, in.tellbit()});
+            }
+            buf.reset();
+            inf.emplace(in, buf);
+            crc = 0;
+            size = 0;
+            first = false;
+            stage = data;
+            wanted = lookahead;
+        }
+        else if (stage == data) {
+            inf->set_lookahead(ended ? 0 : lookahead);
+            size_t count = inf->read(out.data(), out.size());
+            if (inf->done()) {
+                stage = trailer;
+                wanted = 8;
+            }
+            if (count > 0) {
+                crc = inflate::crc32(crc, out.data(), count);
+                size += count;
+                co_yield std::span<const std::byte>(
+                        reinterpret_cast<const std::byte*>(out.data()),
+                        count);
+            }
+        }
+        else {
+            inflate::error e = inflate::_UTIL::check_gzip_trailer(in,
+                    crc, size);
+            if (e != inflate::error::none) {
+                inflate::raise({e, in.tellbit()});
+            }
+            stage = header;
+            wanted = 1;
+        }
+    }
+}
+
+#endif
@@ -0,0 +1,71 @@
+#include "cpudispatch.h"
+
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+
+#ifdef INFLATE_X86_DISPATCH
+#include <cpuid.h>
+#endif
+
+namespace {
+    const char* const tier_names[] =
+        {"scalar", "sse2", "sse4.2", "avx2", "avx512"};
+
+    inflate::cpu_tier detect() noexcept {
+#ifdef INFLATE_X86_DISPATCH
+        unsigned int eax, ebx, ecx, edx;
+        if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx)
+                || !(edx & bit_SSE2)) {
+            return inflate::cpu_tier::scalar;
+        }
+        if (!(ecx & bit_SSE4_2) || !(ecx & bit_PCLMUL)) {
+            return inflate::cpu_tier::sse2;
+        }
+        // the vector registers are only usable if the OS saves them
+        if (!(ecx & bit_OSXSAVE) || !(ecx & bit_AVX)) {
+            return inflate::cpu_tier::sse42;
+        }
+        uint32_t xcr0_lo, xcr0_hi;
+        __asm__("xgetbv" : "=a"(xcr0_lo), "=d"(xcr0_hi) : "c"(0));
+        if ((xcr0_lo & 0x06) != 0x06
+                || !__get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx)
+                || !(ebx & bit_AVX2) || !(ebx & bit_BMI2)) {
+            return inflate::cpu_tier::sse42;
+        }
+        // and for AVX-512, the mask registers and the upper halves
+        if ((xcr0_lo & 0xe0) != 0xe0 || !(ebx & bit_AVX512F)
+                || !(ebx & bit_AVX512BW) || !(ebx & bit_AVX512VL)) {
+            return inflate::cpu_tier::avx2;
+        }
+        return inflate::cpu_tier::avx512;
+#else
+        return inflate::cpu_tier::scalar;
+#endif
+    }
+}
+
+
+inflate::cpu_tier inflate::cpu_detected() noexcept {
+    static const inflate::cpu_tier tier = detect();
+    return tier;
+}
+
+inflate::cpu_tier inflate::cpu_selected() noexcept {
+    static const inflate::cpu_tier tier = [] {
+        inflate::cpu_tier detected = inflate::cpu_detected();
+        const char* forced = std::getenv("INFLATE_CPU");
+        if (forced == nullptr) return detected;
+        for (int i = 0; i <= (int)detected; i++) {
+            if (std::strcmp(forced, tier_names[i]) == 0) {
+                return (inflate::cpu_tier)i;
+            }
+        }
+        return detected;  // unknown, or more than there is
+    }();
+    return tier;
+}
+
+const char* inflate::cpu_tier_name(inflate::cpu_tier tier) noexcept {
+    return tier_names[(int)tier];
+}
@@ -0,0 +1,26 @@
+#ifndef CPUDISPATCH_H
+#define CPUDISPATCH_H
+
+namespace inflate {
+    /* The instruction sets kernels are written for, each tier taking in
+     * those below it: sse42 also has PCLMULQDQ, avx2 also has BMI2, and
+     * avx512 is AVX-512 F, BW and VL. No kernel is written for avx512
+     * yet, it runs the avx2 ones. */
+    enum class cpu_tier {scalar, sse2, sse42, avx2, avx512};
+
+    // The highest tier this CPU and OS support, read through CPUID once
+    cpu_tier cpu_detected() noexcept;
+    /* The tier every kernel is selected for, on its first call: the one
+     * detected, or the one the INFLATE_CPU environment variable names
+     * (scalar, sse2, sse4.2, avx2 or avx512) if that is lower, to
+     * compare kernels on the same host */
+    cpu_tier cpu_selected() noexcept;
+    const char* cpu_tier_name(cpu_tier tier) noexcept;
+}
+
+// Whether the x86 kernels are built, for the headers declaring them
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+    #define INFLATE_X86_DISPATCH
+#endif
+
+#endif
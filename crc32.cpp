@@ -0,0 +1,131 @@
+#include "crc32.h"
+#include "cpudispatch.h"
+
+#ifdef INFLATE_X86_DISPATCH
+#include <immintrin.h>
+#endif
+
+namespace {
+    // tables[k][b] is the crc of byte b followed by k zero bytes,
+    // which lets eight bytes be folded in with independent lookups
+    struct crc32tables {
+        uint32_t t[8][256];
+
+        crc32tables() {
+            for (uint32_t b = 0; b < 256; b++) {
+                uint32_t c = b;
+                for (int i = 0; i < 8; i++) {
+                    c = c & 1 ? 0xedb88320 ^ (c >> 1) : c >> 1;
+                }
+                t[0][b] = c;
+            }
+            for (uint32_t b = 0; b < 256; b++) {
+                for (int k = 1; k < 8; k++) {
+                    t[k][b] = t[0][t[k-1][b] & 0xff] ^ (t[k-1][b] >> 8);
+                }
+            }
+        }
+    };
+
+    const crc32tables tables;
+}
+
+
+uint32_t inflate::crc32_scalar(uint32_t crc, const char* data, size_t len) {
+    const unsigned char* p = reinterpret_cast<const unsigned char*>(data);
+    const uint32_t (*t)[256] = tables.t;
+    crc = ~crc;
+
+    // slicing by 8, the words are assembled bytewise to stay endian-neutral
+    for (; len >= 8; len -= 8, p += 8) {
+        uint32_t lo = crc ^ (p[0] | p[1] << 8 | p[2] << 16
+                | (uint32_t)p[3] << 24);
+        crc = t[7][lo & 0xff] ^ t[6][(lo >> 8) & 0xff]
+            ^ t[5][(lo >> 16) & 0xff] ^ t[4][lo >> 24]
+            ^ t[3][p[4]] ^ t[2][p[5]] ^ t[1][p[6]] ^ t[0][p[7]];
+    }
+    while (len--) {
+        crc = t[0][(crc ^ *p++) & 0xff] ^ (crc >> 8);
+    }
+    return ~crc;
+}
+
+#ifdef INFLATE_X86_DISPATCH
+namespace {
+    // x times the constants k, with the next 128 bits of data added
+    __attribute__((target("sse4.2,pclmul")))
+    inline __m128i fold(__m128i x, __m128i k, __m128i next) {
+        return _mm_xor_si128(_mm_xor_si128(
+                    _mm_clmulepi64_si128(x, k, 0x00),
+                    _mm_clmulepi64_si128(x, k, 0x11)), next);
+    }
+
+    __attribute__((target("sse4.2,pclmul")))
+    inline __m128i load(const unsigned char* p) {
+        return _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+    }
+}
+
+__attribute__((target("sse4.2,pclmul")))
+uint32_t inflate::crc32_pclmul(uint32_t crc, const char* data, size_t len) {
+/* Folds four 128 bit lanes over the data 64 bytes at a time with
+ * carry-less multiplies, then those into one, and Barrett reduces it to
+ * 32 bits, as in Intel's "Fast CRC Computation for Generic Polynomials
+ * Using PCLMULQDQ". The constants are x^k mod P for the bit-reflected
+ * polynomial, then P and the Barrett quotient. Short tails go bytewise. */
+    if (len < 64) return crc32_scalar(crc, data, len);
+    const unsigned char* p = reinterpret_cast<const unsigned char*>(data);
+    const __m128i k1k2 = _mm_set_epi64x(0x01c6e41596, 0x0154442bd4);
+    const __m128i k3k4 = _mm_set_epi64x(0x00ccaa009e, 0x01751997d0);
+    const __m128i k5k0 = _mm_set_epi64x(0, 0x0163cd6124);
+    const __m128i poly = _mm_set_epi64x(0x01f7011641, 0x01db710641);
+    const __m128i low32 = _mm_setr_epi32(~0, 0, ~0, 0);
+
+    __m128i x1 = _mm_xor_si128(load(p), _mm_cvtsi32_si128(~crc));
+    __m128i x2 = load(p + 16);
+    __m128i x3 = load(p + 32);
+    __m128i x4 = load(p + 48);
+    for (p += 64, len -= 64; len >= 64; p += 64, len -= 64) {
+        x1 = fold(x1, k1k2, load(p));
+        x2 = fold(x2, k1k2, load(p + 16));
+        x3 = fold(x3, k1k2, load(p + 32));
+        x4 = fold(x4, k1k2, load(p + 48));
+    }
+    x1 = fold(x1, k3k4, x2);
+    x1 = fold(x1, k3k4, x3);
+    x1 = fold(x1, k3k4, x4);
+    for (; len >= 16; p += 16, len -= 16) {
+        x1 = fold(x1, k3k4, load(p));
+    }
+
+    // 128 bits to 64, to 32
+    x1 = _mm_xor_si128(_mm_srli_si128(x1, 8),
+            _mm_clmulepi64_si128(x1, k3k4, 0x10));
+    x1 = _mm_xor_si128(_mm_srli_si128(x1, 4), _mm_clmulepi64_si128(
+                _mm_and_si128(x1, low32), k5k0, 0x00));
+    __m128i q = _mm_clmulepi64_si128(_mm_and_si128(x1, low32), poly, 0x10);
+    x1 = _mm_xor_si128(x1, _mm_clmulepi64_si128(
+                _mm_and_si128(q, low32), poly, 0x00));
+    crc = ~(uint32_t)_mm_extract_epi32(x1, 1);
+    return crc32_scalar(crc, reinterpret_cast<const char*>(p), len);
+}
+#endif
+
+
+namespace {
+    typedef uint32_t (*Checksum)(uint32_t, const char*, size_t);
+
+    Checksum select_crc32() {
+#ifdef INFLATE_X86_DISPATCH
+        if (inflate::cpu_selected() >= inflate::cpu_tier::sse42) {
+            return inflate::crc32_pclmul;
+        }
+#endif
+        return inflate::crc32_scalar;
+    }
+}
+
+uint32_t inflate::crc32(uint32_t crc, const char* data, size_t len) {
+    static const Checksum kernel = select_crc32();
+    return kernel(crc, data, len);
+}
@@ -0,0 +1,32 @@
+#ifndef CRC32_H
+#define CRC32_H
+
+#include <cstddef>
+#include <cstdint>
+
+#include "checksumbuf.h"
+#include "cpudispatch.h"
+
+namespace inflate {
+    /* Updates a running CRC-32 (ISO 3309, as used by gzip and ZIP)
+     * with len bytes, start with crc = 0. Selected on the first call, by
+     * cpu_selected(), from PCLMULQDQ and scalar implementations. */
+    uint32_t crc32(uint32_t crc, const char* data, size_t len);
+
+    // The implementations, for testing and benchmarking
+    uint32_t crc32_scalar(uint32_t crc, const char* data, size_t len);
+#ifdef INFLATE_X86_DISPATCH
+    uint32_t crc32_pclmul(uint32_t crc, const char* data, size_t len);
+#endif
+
+    class crc32stream;
+}
+
+
+class inflate::crc32stream : public checksumstream<inflate::crc32> {
+public:
+    crc32stream(uint32_t crc=0)
+        : checksumstream<inflate::crc32>(crc) {}
+};
+
+#endif
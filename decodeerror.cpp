@@ -0,0 +1,69 @@
+#include "decodeerror.h"
+
+#include <cstdlib>
+#include <ios>
+#include <string>
+
+namespace {
+    std::string message(const inflate::status& s) {
+        std::string text = inflate::describe(s.code);
+        if (s.bit_offset) {
+            text += " at bit " + std::to_string(s.bit_offset);
+        }
+        return text;
+    }
+}
+
+
+const char* inflate::describe(inflate::error e) noexcept {
+    switch (e) {
+        case error::none: return "No error";
+        case error::truncated: return "Error reading compressed block";
+        case error::invalid_block_type: return "Invalid block type";
+        case error::stored_length_mismatch:
+            return "Error decoding block: Stored length mismatch";
+        case error::invalid_code_lengths:
+            return "Preheader Code Invalid: bad code lengths";
+        case error::invalid_code: return "Malformed tree, unindexed code";
+        case error::invalid_literal:
+            return "Error decoding block: Invalid literal symbol";
+        case error::invalid_distance:
+            return "Error decoding block: Invalid distance symbol";
+        case error::distance_too_far: return "Backpointer exceeds buffer size";
+        case error::not_gzip: return "Not in gzip format";
+        case error::not_zlib: return "Not in zlib format";
+        case error::bad_method: return "Compression Method not 8";
+        case error::bad_window: return "Window size larger than 32K";
+        case error::dictionary_required: return "Preset dictionary required";
+        case error::dictionary_mismatch: return "Preset dictionary mismatch";
+        case error::checksum_mismatch: return "Checksum check failed";
+        case error::cannot_open: return "Error opening file";
+        case error::bad_checkpoint: return "Checkpoint does not fit the stream";
+        case error::output_limit: return "Output limit exceeded";
+        case error::ratio_limit: return "Compression ratio limit exceeded";
+        case error::memory_limit: return "Memory limit exceeded";
+        case error::read_failed: return "Error reading input file";
+    }
+    return "Unknown error";
+}
+
+
+inflate::decode_error::decode_error(const inflate::status& s)
+    : std::invalid_argument(message(s))
+    , s(s) {
+}
+
+void inflate::raise(const inflate::status& s) {
+#if defined(__cpp_exceptions) || defined(__EXCEPTIONS)
+    switch (s.code) {
+        case error::truncated:
+        case error::cannot_open:
+        case error::read_failed:
+            throw std::ios_base::failure(message(s));
+        default:
+            throw inflate::decode_error(s);
+    }
+#else
+    std::abort();
+#endif
+}
@@ -0,0 +1,64 @@
+#ifndef DECODEERROR_H
+#define DECODEERROR_H
+
+#include <cstdint>
+#include <stdexcept>
+
+namespace inflate {
+    // What stopped decoding, see describe()
+    enum class error {
+        none = 0,
+        truncated,              // the input ended mid-stream
+        invalid_block_type,
+        stored_length_mismatch,
+        invalid_code_lengths,   // in a dynamic block header
+        invalid_code,           // bits that begin no Huffman code
+        invalid_literal,        // literal/length symbols 286 and 287
+        invalid_distance,       // distance symbols 30 and 31
+        distance_too_far,       // before the start of the stream or window
+        not_gzip,
+        not_zlib,
+        bad_method,             // compression method other than deflate
+        bad_window,             // zlib window larger than 32K
+        dictionary_required,
+        dictionary_mismatch,
+        checksum_mismatch,
+        cannot_open,
+        bad_checkpoint,         // not a checkpoint of this stream
+        output_limit,           // more output than limits allow
+        ratio_limit,            // more output per byte of input
+        memory_limit,           // more memory than limits allow
+        read_failed             // the input file could not be read
+    };
+
+    /* Where decoding stopped, as a bit offset into the input file just
+     * past whatever was invalid */
+    struct status {
+        inflate::error code;
+        uint64_t bit_offset;
+
+        inline explicit operator bool() const noexcept
+            {return code != inflate::error::none;}
+    };
+
+    const char* describe(inflate::error e) noexcept;
+
+    class decode_error;
+
+    /* Throws the exception the throwing API has always thrown for code:
+     * std::ios_base::failure for input that cannot be read, decode_error
+     * otherwise. Without exceptions, aborts. */
+    [[noreturn]] void raise(const status& s);
+}
+
+
+class inflate::decode_error : public std::invalid_argument {
+public:
+    decode_error(const inflate::status& s);
+    inline const inflate::status& where() const noexcept {return s;}
+
+private:
+    inflate::status s;
+};
+
+#endif
@@ -0,0 +1,62 @@
+#include "decodercache.h"
+
+#include <cstring>
+
+
+inflate::decoder_cache::decoder_cache(int capacity)
+    : capacity(capacity > 1 ? capacity : 1)
+    , tick(0)
+    , hit_count(0)
+    , miss_count(0) {
+    entries.reserve(this->capacity);
+}
+
+void inflate::decoder_cache::get(const uint8_t* lengths,
+        int literals, int distances,
+        const inflate::Decoder*& literals_dec,
+        const inflate::Decoder*& distance_dec) noexcept {
+/* A few entries are searched end to end: comparing hashes costs nothing
+ * beside reading the header, let alone building its tables */
+    int count = literals + distances;
+    uint64_t hash = 14695981039346656037ull;  // FNV-1a
+    for (int i = 0; i < count; i++) {
+        hash = (hash ^ lengths[i]) * 1099511628211ull;
+    }
+    hash = (hash ^ literals) * 1099511628211ull;
+
+    entry* found = nullptr;
+    for (entry& e : entries) {
+        if (e.hash == hash && e.literals == literals
+                && e.distances == distances
+                && std::memcmp(e.lengths, lengths, count) == 0) {
+            found = &e;
+            break;
+        }
+    }
+    if (found) {
+        hit_count++;
+    }
+    else {
+        miss_count++;
+        if (entries.size() < capacity) {
+            entries.emplace_back();
+            found = &entries.back();
+        }
+        else {
+            found = &entries[0];
+            for (entry& e : entries) {
+                if (e.used < found->used) found = &e;
+            }
+        }
+        found->hash = hash;
+        found->literals = literals;
+        found->distances = distances;
+        std::memcpy(found->lengths, lengths, count);
+        inflate::build_decoder(found->literals_dec, lengths, literals);
+        inflate::build_decoder(found->distance_dec, lengths + literals,
+                distances);
+    }
+    found->used = ++tick;
+    literals_dec = &found->literals_dec;
+    distance_dec = &found->distance_dec;
+}
@@ -0,0 +1,56 @@
+#ifndef DECODERCACHE_H
+#define DECODERCACHE_H
+
+#include <cstdint>
+#include <vector>
+
+#include "inflate.h"
+
+namespace inflate {
+    class decoder_cache;
+}
+
+
+// Keeps the decoders of the last few dynamic block headers, for streams
+// that repeat the same header over many blocks or members: each one is
+// then built once. Headers are told apart by a hash of their code
+// lengths, compared in full where the hashes match, and the least recently
+// used entry makes way for a header not seen before.
+class inflate::decoder_cache {
+public:
+    explicit decoder_cache(int capacity=8);
+
+    /* Points literals_dec and distance_dec at the decoders for these code
+     * lengths, literals of them followed by distances, building them into
+     * the least recently used entry if no entry has them. That may be the
+     * entry an earlier call pointed at, so a cache should only be used by
+     * one inflater at a time. */
+    void get(const uint8_t* lengths, int literals, int distances,
+            const inflate::Decoder*& literals_dec,
+            const inflate::Decoder*& distance_dec) noexcept;
+
+    // headers found in the cache, and built into it
+    inline uint64_t hits() const noexcept {return hit_count;}
+    inline uint64_t misses() const noexcept {return miss_count;}
+    inline size_t memory() const noexcept
+        {return sizeof(*this) + capacity * sizeof(entry);}
+
+private:
+    struct entry {
+        uint64_t hash;
+        uint64_t used;  // when it was last got, by tick
+        int literals;
+        int distances;
+        uint8_t lengths[286 + 30];
+        inflate::Decoder literals_dec;
+        inflate::Decoder distance_dec;
+    };
+
+    std::vector<entry> entries;  // reserved up front, so never moving
+    size_t capacity;
+    uint64_t tick;
+    uint64_t hit_count;
+    uint64_t miss_count;
+};
+
+#endif
@@ -1,12 +1,168 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
 #include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <unistd.h>
 #include "inflate.h"
+#include "fdstream.h"
+#include "grep.h"
+#include "untarstream.h"
 
 int main(int argc, char** argv) {
     if (argc < 2) {
         std::cout << "Please supply a file to gunzip" << std::endl;
+        std::cout << "usage: " << argv[0]
+            << " [-z|-r|-x dir|-R|-t|-l|-g pattern] [-d dictionary]"
+            << " [-c n] [-a n]" << std::endl
+            << "    [-L output,ratio,memory] file..." << std::endl
+            << "  -z  files are zlib streams" << std::endl
+            << "  -r  files are raw deflate streams" << std::endl
+            << "  -x  extract .tar.gz files into dir" << std::endl
+            << "  -R  recover what can be decoded of damaged gzip files"
+            << std::endl
+            << "  -t  test the integrity of gzip files, writing nothing"
+            << std::endl
+            << "  -l  list the members of gzip files" << std::endl
+            << "  -g  print the lines of gzip files holding the pattern,"
+            << " may be repeated" << std::endl
+            << "  -d  preset dictionary for zlib and raw streams"
+            << std::endl
+            << "  -c  with -t, cache the codes of n dynamic block headers"
+            << std::endl
+            << "  -a  with -t, keep n reads of the file in flight"
+            << std::endl
+            << "  -L  stop gzip files decoding to more bytes, more bytes"
+            << " per byte read," << std::endl
+            << "      or needing more memory than given, 0 for no limit"
+            << std::endl;
         return 1;
     }
-    for (int i=1; i<argc; i++)
-        inflate::gunzip(argv[i]);
-    return 0;
+    char format = 'g';
+    inflate::dictionary dict;
+    std::string destdir;
+    std::vector<std::string> patterns;
+    int cached_headers = 0;
+    int read_ahead = 0;
+    inflate::limits bounds = {0, 0, 0};
+    int status = 0;
+    // decoded data goes out in large blocks, spliced into pipes
+    fdstream out(STDOUT_FILENO);
+    for (int i=1; i<argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "-z" || arg == "-r" || arg == "-R"
+                || arg == "-t" || arg == "-l") {
+            format = arg[1];
+        }
+        else if (arg == "-x" && i + 1 < argc) {
+            format = 'x';
+            destdir = argv[++i];
+        }
+        else if (arg == "-g" && i + 1 < argc) {
+            format = 'g';
+            patterns.push_back(argv[++i]);
+        }
+        else if (arg == "-d" && i + 1 < argc) {
+            std::ifstream dictfile(argv[++i], std::ios::binary);
+            std::ostringstream bytes;
+            bytes << dictfile.rdbuf();
+            dict = inflate::dictionary(bytes.str());
+        }
+        else if (arg == "-c" && i + 1 < argc) {
+            cached_headers = std::atoi(argv[++i]);
+        }
+        else if (arg == "-a" && i + 1 < argc) {
+            read_ahead = std::atoi(argv[++i]);
+        }
+        else if (arg == "-L" && i + 1 < argc) {
+            char* next = argv[++i];
+            for (uint64_t* bound : {&bounds.max_output, &bounds.max_ratio,
+                    &bounds.max_memory}) {
+                *bound = std::strtoull(next, &next, 10);
+                if (*next == ',') next++;
+            }
+        }
+        else if (format == 'z') {
+            std::cout.flush();
+            inflate::uncompress(arg, out, dict);
+            out.flush();
+        }
+        else if (format == 'r') {
+            std::cout.flush();
+            inflate::inflate_raw(arg, out, dict);
+            out.flush();
+        }
+        else if (format == 'x') {
+            inflate::untgz(arg, destdir);
+        }
+        else if (format == 'R') {
+            std::cout.flush();
+            auto damages = inflate::gunzip_recover(arg, out, true);
+            out.flush();
+            for (auto& d : damages) {
+                std::cerr << arg << ": " << inflate::describe(d.failure.code)
+                    << " at bit " << d.failure.bit_offset
+                    << ", after " << d.output_offset << " bytes";
+                if (d.resumed_at) {
+                    std::cerr << ", resumed at bit " << d.resumed_at;
+                }
+                std::cerr << std::endl;
+                status = 2;
+            }
+        }
+        else if (format == 't') {
+            auto start = std::chrono::steady_clock::now();
+            inflate::verification v = inflate::gunzip_verify(arg,
+                    bounds, cached_headers, read_ahead);
+            std::chrono::duration<double> elapsed =
+                std::chrono::steady_clock::now() - start;
+            if (v.status) {
+                std::cerr << arg << ": " << inflate::describe(v.status.code);
+                if (v.status.bit_offset) {
+                    std::cerr << " at bit " << v.status.bit_offset;
+                }
+                std::cerr << std::endl;
+                status = 1;
+            }
+            else {
+                std::cout << arg << ": OK, " << v.uncompressed_size
+                    << " bytes, " << v.uncompressed_size / 1e6
+                        / std::max(elapsed.count(), 1e-9)
+                    << " MB/s";
+                if (v.cache_hits + v.cache_misses > 0) {
+                    std::cout << ", " << v.cache_hits << " of "
+                        << v.cache_hits + v.cache_misses
+                        << " headers cached";
+                }
+                std::cout << std::endl;
+            }
+        }
+        else if (format == 'l') {
+            for (auto& m : inflate::scan(arg)) {
+                std::cout << arg << ": member at " << m.offset << ", "
+                    << m.end - m.offset << " bytes, " << m.size
+                    << " decoded";
+                if (!m.fname.empty()) {
+                    std::cout << ", " << m.fname;
+                }
+                std::cout << std::endl;
+            }
+        }
+        else if (!patterns.empty()) {
+            inflate::grep(arg, patterns,
+                    [&](uint64_t offset, std::string_view line) {
+                        std::cout << arg << ':' << offset << ':';
+                        std::cout.write(line.data(), line.size()) << '\n';
+                    }, bounds);
+        }
+        else {
+            std::cout.flush();
+            inflate::gunzip(arg, out, bounds);
+            out.flush();
+        }
+    }
+    return status;
 }
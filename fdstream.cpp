@@ -0,0 +1,157 @@
+#include "fdstream.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#if defined(__linux__) && defined(F_SETPIPE_SZ)
+#define INFLATE_VMSPLICE
+#endif
+
+namespace {
+    // a descriptor opened non-blocking may take nothing for now
+    bool wait_writable(int fd) {
+        if (errno == EINTR) return true;
+        if (errno != EAGAIN && errno != EWOULDBLOCK) return false;
+        pollfd p = {fd, POLLOUT, 0};
+        return poll(&p, 1, -1) >= 0 || errno == EINTR;
+    }
+}
+
+
+fdbuf::fdbuf(int fd, size_t block_size/*=1<<20*/)
+    : fd(fd)
+    , to_pipe(false)
+    , block(nullptr) {
+    size_t page = sysconf(_SC_PAGESIZE);
+#ifdef INFLATE_VMSPLICE
+    struct stat st;
+    if (fstat(fd, &st) == 0 && S_ISFIFO(st.st_mode)) {
+        // grown to hold a whole block if allowed
+        fcntl(fd, F_SETPIPE_SZ,
+                (int)std::min<size_t>(block_size, 1 << 30));
+        to_pipe = fcntl(fd, F_GETPIPE_SZ) > 0;
+    }
+#endif
+    block_size = std::max(block_size, page);
+    this->block_size = (block_size + page - 1) / page * page;
+    map_block();
+}
+
+fdbuf::~fdbuf() {
+    forward();
+    if (block) munmap(block, block_size);
+}
+
+bool fdbuf::map_block() {
+/* Failing that, every write goes straight out */
+    void* p = mmap(nullptr, block_size, PROT_READ|PROT_WRITE,
+            MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+    block = p == MAP_FAILED ? nullptr : static_cast<char*>(p);
+    if (!block) {
+        to_pipe = false;
+        block_size = 0;
+    }
+    setp(block, block + block_size);
+    return block != nullptr;
+}
+
+bool fdbuf::forward() {
+/* Only whole blocks are spliced, each then swapped for a fresh one; the
+ * rest is copied, and the block stays */
+    size_t n = pptr() - pbase();
+    bool ok = true;
+    if (n == block_size && to_pipe) {
+        ok = splice_out(pbase(), n);
+        munmap(block, block_size);
+        map_block();
+        return ok;
+    }
+    if (n > 0) {
+        ok = write_out(pbase(), n);
+    }
+    setp(block, block + block_size);
+    return ok;
+}
+
+bool fdbuf::write_out(const char* s, size_t n) {
+    while (n > 0) {
+        ssize_t written = write(fd, s, n);
+        if (written < 0) {
+            if (!wait_writable(fd)) return false;
+            continue;
+        }
+        s += written;
+        n -= written;
+    }
+    return true;
+}
+
+bool fdbuf::splice_out(const char* s, size_t n) {
+#ifdef INFLATE_VMSPLICE
+    while (n > 0) {
+        iovec iov = {const_cast<char*>(s), n};
+        // gifted, it is never touched again
+        ssize_t spliced = vmsplice(fd, &iov, 1, SPLICE_F_GIFT);
+        if (spliced < 0) {
+            if (errno == EINVAL || errno == ENOSYS) {
+                to_pipe = false;    // not a pipe after all
+                return write_out(s, n);
+            }
+            if (!wait_writable(fd)) return false;
+            continue;
+        }
+        s += spliced;
+        n -= spliced;
+    }
+    return true;
+#else
+    return write_out(s, n);
+#endif
+}
+
+int fdbuf::overflow(int c) {
+    bool ok = forward();
+    if (c == EOF) {
+        return ok ? !EOF : EOF;
+    }
+    if (pptr() < epptr()) {
+        *pptr() = (char)c;
+        pbump(1);
+        return ok ? c : EOF;
+    }
+    char ch = (char)c;
+    return write_out(&ch, 1) && ok ? c : EOF;
+}
+
+std::streamsize fdbuf::xsputn(const char* s, std::streamsize n) {
+/* Filling blocks, which then go out whole. Only writes of whole blocks
+ * that are not going into a pipe skip them, to go out as they are. */
+    std::streamsize wanted = n;
+    bool ok = true;
+    while (n > 0) {
+        if (pptr() == pbase() && !to_pipe && (size_t)n >= block_size) {
+            return write_out(s, n) && ok ? wanted : 0;
+        }
+        std::streamsize part = std::min<std::streamsize>(n,
+                epptr() - pptr());
+        std::memcpy(pptr(), s, part);
+        pbump(part);
+        s += part;
+        n -= part;
+        if (pptr() == epptr()) {
+            ok = forward() && ok;
+        }
+    }
+    return ok ? wanted : 0;
+}
+
+int fdbuf::sync() {
+    return forward() ? 0 : -1;
+}
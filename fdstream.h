@@ -0,0 +1,59 @@
+#ifndef FDSTREAM_H
+#define FDSTREAM_H
+
+#include <cstddef>
+#include <ostream>
+#include <streambuf>
+
+// Writes to a file descriptor in large blocks, sparing decoded output the
+// copies and small writes of std::cout. Blocks are page aligned and mapped
+// for this alone: into a pipe they are handed to the kernel by vmsplice,
+// which maps their pages into the pipe rather than copying them, and to
+// anything else they go in one write() each. A block spliced is given up
+// to the pipe, and the next one freshly mapped.
+class fdbuf : public std::streambuf {
+public:
+    // the descriptor stays the caller's
+    explicit fdbuf(int fd, size_t block_size = 1 << 20);
+    ~fdbuf();
+    fdbuf(const fdbuf&) = delete;
+    fdbuf& operator=(const fdbuf&) = delete;
+
+    // whether blocks go into a pipe by vmsplice
+    inline bool splicing() const noexcept {return to_pipe;}
+
+private:
+    bool map_block();
+    bool forward();
+    bool write_out(const char* s, size_t n);
+    bool splice_out(const char* s, size_t n);
+
+    virtual int overflow(int c);
+    virtual std::streamsize xsputn(const char* s, std::streamsize n);
+    virtual int sync();
+
+    int fd;
+    bool to_pipe;
+    size_t block_size;
+    /* Pages spliced stay referenced by the pipe until read, and by any
+     * pipe the reader splices or tees them on to after that, so a block
+     * spliced is never written again: it is unmapped, and the pages go
+     * with the pipe */
+    char* block;
+};
+
+
+class fdstream : public std::ostream {
+public:
+    explicit fdstream(int fd, size_t block_size = 1 << 20)
+        : std::ostream(&fbuf)
+        , fbuf(fd, block_size) {}
+
+    ~fdstream() { flush(); }
+
+    inline bool splicing() const noexcept {return fbuf.splicing();}
+private:
+    fdbuf fbuf;
+};
+
+#endif
@@ -0,0 +1,165 @@
+#ifndef GENERATOR_H
+#define GENERATOR_H
+
+// C++20 coroutines: what chunks() returns
+#include <coroutine>
+#include <exception>
+#include <iterator>
+#include <optional>
+#include <utility>
+
+namespace inflate {
+    template <class T> class generator;
+    template <class T> class async_generator;
+}
+
+
+// A coroutine that co_yields values of T to a range-for loop, running
+// only as far as the next value each time the loop asks for one. The
+// values are only valid until the loop moves on. Exceptions the coroutine
+// throws come out of the loop.
+template <class T>
+class inflate::generator {
+public:
+    struct promise_type {
+        const T* value;
+        std::exception_ptr error;
+
+        generator get_return_object() noexcept {
+            return generator(handle::from_promise(*this));
+        }
+        std::suspend_always initial_suspend() noexcept {return {};}
+        std::suspend_always final_suspend() noexcept {return {};}
+        std::suspend_always yield_value(const T& v) noexcept {
+            value = &v;
+            return {};
+        }
+        void return_void() noexcept {}
+        void unhandled_exception() noexcept
+            {error = std::current_exception();}
+        // only co_yield suspends it
+        template <class U> void await_transform(U&&) = delete;
+    };
+    using handle = std::coroutine_handle<promise_type>;
+
+    class iterator {
+    public:
+        using iterator_category = std::input_iterator_tag;
+        using difference_type = std::ptrdiff_t;
+        using value_type = T;
+
+        iterator() noexcept : coroutine(nullptr) {}
+        explicit iterator(handle coroutine) : coroutine(coroutine)
+            {advance();}
+        inline const T& operator*() const
+            {return *coroutine.promise().value;}
+        inline iterator& operator++() {advance(); return *this;}
+        inline void operator++(int) {advance();}
+        inline bool operator==(std::default_sentinel_t) const noexcept
+            {return !coroutine || coroutine.done();}
+
+    private:
+        void advance() {
+            coroutine.resume();
+            if (coroutine.done() && coroutine.promise().error) {
+                std::rethrow_exception(coroutine.promise().error);
+            }
+        }
+        handle coroutine;
+    };
+
+    generator(generator&& other) noexcept
+        : coroutine(std::exchange(other.coroutine, nullptr)) {}
+    generator& operator=(generator other) noexcept
+        {std::swap(coroutine, other.coroutine); return *this;}
+    ~generator() {if (coroutine) coroutine.destroy();}
+
+    // one pass only
+    inline iterator begin() {return iterator(coroutine);}
+    inline std::default_sentinel_t end() const noexcept {return {};}
+
+private:
+    explicit generator(handle coroutine) noexcept : coroutine(coroutine) {}
+    handle coroutine;
+};
+
+
+// The same for coroutines that co_await as well as co_yield: the consumer
+// co_awaits next() for each value, from a coroutine of its own, and while
+// the generator is suspended on something else, so is the consumer, with
+// no thread waiting on either. Whatever the generator awaits resumes it
+// where it pleases, on an executor's thread for instance, and the
+// consumer is resumed there in turn with the next value.
+template <class T>
+class inflate::async_generator {
+public:
+    struct promise_type {
+        const T* value = nullptr;
+        std::exception_ptr error;
+        std::coroutine_handle<> consumer;
+
+        // hands over to the consumer when suspending
+        struct to_consumer {
+            bool await_ready() const noexcept {return false;}
+            std::coroutine_handle<> await_suspend(
+                    std::coroutine_handle<promise_type> self) noexcept {
+                return self.promise().consumer;
+            }
+            void await_resume() const noexcept {}
+        };
+
+        async_generator get_return_object() noexcept {
+            return async_generator(handle::from_promise(*this));
+        }
+        std::suspend_always initial_suspend() noexcept {return {};}
+        to_consumer final_suspend() noexcept {return {};}
+        to_consumer yield_value(const T& v) noexcept {
+            value = &v;
+            return {};
+        }
+        void return_void() noexcept {value = nullptr;}
+        void unhandled_exception() noexcept {
+            value = nullptr;
+            error = std::current_exception();
+        }
+    };
+    using handle = std::coroutine_handle<promise_type>;
+
+    class next_value {
+    public:
+        explicit next_value(handle coroutine) noexcept
+            : coroutine(coroutine) {}
+        bool await_ready() const noexcept {return false;}
+        std::coroutine_handle<> await_suspend(
+                std::coroutine_handle<> consumer) noexcept {
+            coroutine.promise().consumer = consumer;
+            return coroutine;
+        }
+        // the value, valid until next() is awaited again, or none at the end
+        std::optional<T> await_resume() const {
+            promise_type& p = coroutine.promise();
+            if (p.error) std::rethrow_exception(std::exchange(p.error, {}));
+            if (p.value == nullptr) return std::nullopt;
+            return *p.value;
+        }
+    private:
+        handle coroutine;
+    };
+
+    async_generator(async_generator&& other) noexcept
+        : coroutine(std::exchange(other.coroutine, nullptr)) {}
+    async_generator& operator=(async_generator other) noexcept
+        {std::swap(coroutine, other.coroutine); return *this;}
+    // only while suspended, at a co_yield or before the first next()
+    ~async_generator() {if (coroutine) coroutine.destroy();}
+
+    // not to be awaited again once it gave none
+    inline next_value next() noexcept {return next_value(coroutine);}
+
+private:
+    explicit async_generator(handle coroutine) noexcept
+        : coroutine(coroutine) {}
+    handle coroutine;
+};
+
+#endif
@@ -0,0 +1,54 @@
+#include "grep.h"
+#include "bytesearch.h"
+#include "linereader.h"
+
+#include <algorithm>
+
+
+uint64_t inflate::grep(std::string fn,
+        const std::vector<std::string>& patterns,
+        std::function<void(uint64_t, std::string_view)> found) {
+    return inflate::grep(fn, patterns, found, inflate::limits{0, 0, 0});
+}
+
+uint64_t inflate::grep(std::string fn,
+        const std::vector<std::string>& patterns,
+        std::function<void(uint64_t, std::string_view)> found,
+        const inflate::limits& bounds) {
+/* Searches many lines at once, from the first match of any pattern back
+ * and forward to the ends of its line, rather than line by line. Where
+ * each pattern next matches is kept, so each is only searched for again
+ * once a line has been passed over it. */
+    inflate::linereader reader(fn);
+    reader.set_limits(bounds);
+    std::string_view lines;
+    std::vector<const char*> next(patterns.size());
+    uint64_t count = 0;
+
+    while (reader.next_lines(lines)) {
+        const char* first = lines.data();
+        const char* last = first + lines.size();
+        std::fill(next.begin(), next.end(), nullptr);
+
+        while (first < last) {
+            const char* hit = last;
+            for (size_t i = 0; i < patterns.size(); i++) {
+                if (next[i] == nullptr || next[i] < first) {
+                    next[i] = inflate::find_string(first, last,
+                            patterns[i].data(), patterns[i].size());
+                }
+                hit = std::min(hit, next[i]);
+            }
+            if (hit == last) break;
+
+            const char* start = hit;
+            while (start > lines.data() && start[-1] != '\n') start--;
+            const char* end = inflate::find_byte(hit, last, '\n');
+            found(reader.offset() + (start - lines.data()),
+                    std::string_view(start, end - start));
+            count++;
+            first = end + 1;
+        }
+    }
+    return count;
+}
@@ -0,0 +1,25 @@
+#ifndef GREP_H
+#define GREP_H
+
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace inflate {
+    struct limits;
+
+    /* Calls found with the offset in the decompressed data and the text
+     * (without its '\n') of every line of a gzip file holding any of the
+     * patterns, as fixed strings without '\n'. The lines are only valid during the
+     * call. Returns the number of lines found. Throws as gunzip does. */
+    uint64_t grep(std::string fn, const std::vector<std::string>& patterns,
+            std::function<void(uint64_t, std::string_view)> found);
+    // the same within bounds, see linereader::set_limits
+    uint64_t grep(std::string fn, const std::vector<std::string>& patterns,
+            std::function<void(uint64_t, std::string_view)> found,
+            const limits& bounds);
+}
+
+#endif
@@ -1,76 +1,114 @@
 #include "huffmantree.h"
 #include "ifbstream.h"
 
+#include <algorithm>
+
+void inflate::huffmantree::clear(int longest, bool complete) noexcept {
+    std::fill_n(lengths.begin(), symbols, 0);
+    symbols = 0;
+    if (longest > max_length) longest = max_length;
+    if (longest < 1) longest = 1;
+    root_bits = longest < table_bits ? longest : table_bits;
+    link_bits = longest - root_bits;
+    used = 1 << root_bits;
+    // without links to tell apart from those left over, a complete code
+    // overwrites every entry
+    if (!complete || link_bits > 0) {
+        std::fill_n(table.begin(), used, inflate::huffmanentry({-1, 0, 0}));
+    }
+}
+
 void inflate::huffmantree::insert(int codelength,
-        inflate::Code code, inflate::Symbol symbol) {
-    if (root == nullptr){
-        root = new inflate::huffmannode({-1, nullptr, nullptr});
+        inflate::Code code, inflate::Symbol symbol) noexcept {
+    if (codelength < 1 || codelength > root_bits + link_bits
+            || symbol < 0 || symbol >= max_symbols) {
+        return;
     }
-    inflate::huffmannode* curr = root;
-    // read code bit by bit
-    for( int i = codelength - 1; i >= 0; i--){
-        if ((code >> i) & 0x01) {  // 1
-            if (curr->one == nullptr) {
-                curr->one = new inflate::huffmannode({-1, nullptr, nullptr});
-            }
-            curr = curr->one;
-        }
-        else {  // 0
-            if (curr->zero == nullptr) {
-                curr->zero = new inflate::huffmannode({-1, nullptr, nullptr});
-            }
-            curr = curr->zero;
-        }
+    codes[symbol] = code;
+    lengths[symbol] = codelength;
+    symbols = std::max(symbols, symbol + 1);
+
+    // the tables are indexed by bits in the order they are read,
+    // so most significant bit of the code first
+    int index = 0;
+    for (int i = 0; i < codelength; i++) {
+        index |= ((code >> (codelength - 1 - i)) & 0x01) << i;
     }
-    curr->symbol = symbol;
-}
 
-inflate::Symbol inflate::huffmantree::read_out(ifbstream& in) const {
-    /*Decode a single symbol from stream in, using the huffman_tree*/
-    inflate::huffmannode* curr = root;
-    inflate::Symbol symbol = curr->symbol;
-#ifdef DEBUG_DUMP_CODES
-    std::cout << std::endl;
-    std::ostringstream buf;
-#endif
-    
-    while(symbol < 0) {
-        if (in.next()) {  // next bit is 1
-#ifdef DEBUG_DUMP_CODES
-            buf << 1;
-#endif
-            curr = curr->one;
-        }
-        else {           // next bit is 0
-#ifdef DEBUG_DUMP_CODES
-            buf << 0;
-#endif
-            curr = curr->zero;
+    int start = 0;  // of the table the code goes in
+    int bits = root_bits;
+    if (codelength > root_bits) {
+        inflate::huffmanentry& link = table[index & ((1 << root_bits) - 1)];
+        if (!link.link) {
+            if (used + (1 << link_bits) > (int)table.size()) return;
+            link = {(int16_t)used, (uint8_t)root_bits, (uint8_t)link_bits};
+            std::fill_n(table.begin() + used, 1 << link_bits,
+                    inflate::huffmanentry({-1, 0, 0}));
+            used += 1 << link_bits;
         }
+        start = link.symbol;
+        bits = link_bits;
+        index >>= root_bits;
+        codelength -= root_bits;
+    }
+    // fill every entry whose low codelength bits are this code
+    for (; index < (1 << bits); index += 1 << codelength) {
+        table[start + index] = {(int16_t)symbol, (uint8_t)codelength, 0};
+    }
+}
 
-        if (curr == nullptr){  // this leaf has code -1 probably
-#ifdef DEBUG_DUMP_CODES
-            std::cout << buf.str();
-#endif
-            throw std::invalid_argument("Malformed tree, unindexed code");
+inflate::Symbol inflate::huffmantree::read_out(ifbstream& in)
+        const noexcept {
+/* Decodes a single symbol bit by bit, so as to read no further than its
+ * code at the end of the input. Once k bits are read, the entry they
+ * index holds a code of length k if that is the code they are. */
+    if (empty()) return -1;
+    inflate::Symbol symbol = -1;
+    int index = 0;
+    for (int k = 0; k < root_bits && symbol < 0; k++) {
+        index |= in.take(1) << k;
+        const inflate::huffmanentry& entry = table[index];
+        if (!entry.link && entry.length == k + 1) symbol = entry.symbol;
+    }
+    if (symbol < 0 && table[index].link) {
+        const inflate::huffmanentry* subtable = &table[table[index].symbol];
+        index = 0;
+        for (int k = 0; k < link_bits && symbol < 0; k++) {
+            index |= in.take(1) << k;
+            if (subtable[index].length == k + 1) {
+                symbol = subtable[index].symbol;
+            }
         }
-        symbol = curr->symbol;
     }
-
 #ifdef DEBUG_DUMP_CODES
-    std::cout << std::setw(15) << std::left << buf.str();
-    std::cout << " :" << std::setw(3) << symbol << " = ";
+    std::cout << std::endl << " :" << std::setw(3) << symbol << " = ";
     std::cout << std::setw(0);
 #endif
     return symbol;
-
 }
 
 #include "binarytreenode.h"
 
 std::string inflate::huffmantree::str() {
-    return serialize(root);
+/* The code as a tree, built for the purpose */
+    if (empty()) return serialize<inflate::huffmannode>(nullptr);
+    std::vector<inflate::huffmannode> nodes;
+    // a node for each bit of each code at most, never moving
+    nodes.reserve(1 + max_symbols * (table_bits + sub_bits));
+    nodes.push_back({-1, nullptr, nullptr});
+    for (int symbol = 0; symbol < symbols; symbol++) {
+        if (lengths[symbol] == 0) continue;
+        inflate::huffmannode* curr = &nodes[0];
+        for (int i = lengths[symbol] - 1; i >= 0; i--) {
+            inflate::huffmannode*& next = ((codes[symbol] >> i) & 0x01)
+                ? curr->one : curr->zero;
+            if (next == nullptr) {
+                nodes.push_back({-1, nullptr, nullptr});
+                next = &nodes.back();
+            }
+            curr = next;
+        }
+        curr->symbol = symbol;
+    }
+    return serialize(&nodes[0]);
 }
-
-
-
@@ -1,6 +1,9 @@
 #ifndef HUFFMANTREE_H
 #define HUFFMANTREE_H
 
+#include <array>
+#include <cstdint>
+
 #include "inflate.h"
 #include "ifbstream.h"
 
@@ -10,29 +13,86 @@ namespace inflate {
 
     class huffmantree;
     struct huffmannode;
+    struct huffmanentry;
 }
 
 
+// A node of the tree str() describes
+struct inflate::huffmannode {
+    Symbol symbol;  // -1 indicates inner node
+    inflate::huffmannode* zero;
+    inflate::huffmannode* one;
+};
+
+/* Indexed by the next root_bits bits of input. Codes no longer than that
+ * fill every entry they prefix. Longer ones share a link to a subtable
+ * indexed by the bits after those, which they fill in the same way. */
+struct inflate::huffmanentry {
+    int16_t symbol;   // for links, where the subtable starts
+    uint8_t length;   // bits of the code, 0 for bits that start no code
+    uint8_t link;     // for links, the bits indexing the subtable
+};
+
+
+// The decoding tables for a canonical Huffman code, held in place so that
+// building one allocates nothing
 class inflate::huffmantree : public inflate::Decodertype {
 public:
-    huffmantree() : root(nullptr) {}
-    
-    void insert(int codelength, Code, Symbol);
-    inflate::Symbol read_out(ifbstream& in) const;
+    huffmantree()
+        : symbols(max_symbols) {clear(table_bits, false);}
+
+    // codes longer than the clear() said are left out
+    void insert(int codelength, Code, Symbol) noexcept;
+    /* Forgets every code, to build another whose codes are up to
+     * longest bits long. A complete code fills the whole of the tables,
+     * so they need not always be emptied first. */
+    void clear(int longest, bool complete) noexcept;
+    inflate::Symbol read_out(ifbstream& in) const noexcept;
     inline bool empty() const noexcept
-        {return root == nullptr;}
+        {return symbols == 0;}
     std::string str();
 
+    /* Decodes with the lookup table, without checking for the end of
+     * input: the caller has refilled the stream's accumulator */
+    template <class Bits=plain_bits>
+    inline inflate::Symbol read_fast(ifbstream& in) const noexcept;
+
+    // codes up to this long are looked up in one step
+    static const int table_bits = 10;
+    // and the rest, up to 15 bits, in a second
+    static const int sub_bits = 5;
+    static const int max_length = table_bits + sub_bits;
+    static const int max_symbols = 288;
+    /* A complete code has at least two codes below each link, so 144
+     * subtables are enough. Incomplete codes running out of them are
+     * left partly unindexed. */
+    static const int max_subtables = max_symbols / 2;
+
 private:
-    inflate::huffmannode* root;
+    std::array<inflate::huffmanentry,
+        (1 << table_bits) + max_subtables * (1 << sub_bits)> table;
+    int root_bits;  // up to table_bits, as short as the longest code
+    int link_bits;  // the rest of the longest code
+    int used;     // entries of table taken, by the root and subtables
+    int symbols;  // one past the highest symbol with a code
+    // for str()
+    std::array<uint16_t, max_symbols> codes;
+    std::array<uint8_t, max_symbols> lengths;
 };
 
 
-struct inflate::huffmannode {
-    Symbol symbol;  // -1 indicates inner node
-    inflate::huffmannode* zero;
-    inflate::huffmannode* one;
-};
+template <class Bits>
+inline inflate::Symbol inflate::huffmantree::read_fast(ifbstream& in)
+        const noexcept {
+    const inflate::huffmanentry* entry = &table[in.peek<Bits>(root_bits)];
+    if (entry->link) {
+        int bits = entry->link;
+        in.consume<Bits>(root_bits);
+        entry = &table[entry->symbol + in.peek<Bits>(bits)];
+    }
+    if (entry->length == 0) return -1;
+    in.consume<Bits>(entry->length);
+    return entry->symbol;
+}
 
 #endif
-
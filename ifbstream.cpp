@@ -1,5 +1,9 @@
 #include "ifbstream.h"
+#include "decodeerror.h"
+
+#include <algorithm>
 #include <iostream>
+#include <fcntl.h>
 #include <fstream>
 #include <unistd.h>
 
@@ -7,25 +11,142 @@
 #include <bitset>
 #endif
 
-unsigned int ifbstream::next() {
-    if (pos >= 8) {
-        pos = 0;
-        if(!in.get(buf)) {
-            throw std::ios_base::failure("Error reading compressed block");
+ifbstream::ifbstream(std::string fn, int read_ahead,
+        size_t block_size/*=asyncreader::default_block_size*/)
+    : fd(::open(fn.c_str(), O_RDONLY|O_CLOEXEC))
+    , block_left(0)
+    , fed(false)
+    , buffer(buffer_size) {
+    if (fd >= 0) {
+        ahead.reset(new asyncreader(fd, read_ahead, block_size));
+    }
+    discard(0);
+}
+
+ifbstream::~ifbstream() {
+    close();
+}
+
+void ifbstream::close() {
+    ahead.reset();  // before the file it reads
+    if (fd >= 0) {
+        ::close(fd);
+        fd = -1;
+    }
+    in.close();
+}
+
+void ifbstream::seekg(std::streampos p) {
+    if (ahead) {
+        ahead->seek(p);
+        block_left = 0;
+    }
+    else {
+        in.clear();
+        in.seekg(p);
+    }
+    discard(p);
+}
+
+std::streamsize ifbstream::read_file(char* s, std::streamsize count)
+        noexcept {
+/* Reads what it can of count bytes at the end of what was read, from the
+ * blocks read ahead if there are any */
+    if (!ahead) {
+        in.read(s, count);
+        return in.gcount();
+    }
+    std::streamsize got = 0;
+    while (got < count) {
+        if (block_left == 0) {
+            block_left = ahead->next(block);
+            if (block_left == 0) break;
         }
+        size_t n = std::min<size_t>(block_left, count - got);
+        std::memcpy(s + got, block, n);
+        block += n;
+        block_left -= n;
+        got += n;
     }
-    unsigned int bit = (buf >> pos) & 0x01;
-    pos++;
-    return bit;
+    return got;
 }
 
-int ifbstream::read(int count) {
-    int bits = 0;
-    int bit;
+char* ifbstream::reserve_input(size_t n) {
+/* Moves the unread bytes to the front as fill does, and those of the
+ * accumulator before them, growing the buffer if they leave no room for
+ * n more */
+    size_t held = std::min<size_t>((bitcount + 7) / 8,
+            next_byte - buffer.data());
+    const unsigned char* keep = next_byte - held;
+    size_t left = end_byte - keep;
+    offset += keep - buffer.data();
+    std::memmove(buffer.data(), keep, left);
+    if (buffer.size() < left + n) {
+        buffer.resize(left + n);
+    }
+    next_byte = buffer.data() + held;
+    end_byte = buffer.data() + left;
+    return reinterpret_cast<char*>(buffer.data()) + left;
+}
+
+bool ifbstream::fill() noexcept {
+/* Moves the unread bytes to the front of the buffer and reads after them,
+ * returning whether the fast loop can refill from it */
+    if (fed) return end_byte - next_byte >= 8;  // nothing until given
+    size_t left = end_byte - next_byte;
+    offset += next_byte - buffer.data();
+    std::memmove(buffer.data(), next_byte, left);
+    std::streamsize got = read_file(
+            reinterpret_cast<char*>(buffer.data()) + left,
+            buffer.size() - left);
+    next_byte = buffer.data();
+    end_byte = next_byte + left + got;
+    return end_byte - next_byte >= 8;
+}
 
-    for(int i = 0; i < count; i++) {
-        bit = next();
-        bits |= (bit << i);
+void ifbstream::need(int count) noexcept {
+    while (bitcount < count) {
+        if (next_byte == end_byte) {
+            fill();
+            if (next_byte == end_byte) {
+                overrun = true;     // leaves zero bits to read
+                bitcount = count;
+                return;
+            }
+        }
+        bitbuf |= uint64_t(*next_byte++) << bitcount;
+        bitcount += 8;
+    }
+}
+
+void ifbstream::seekbit(uint64_t bit) noexcept {
+    std::streamoff byte = bit / 8;
+    if (byte >= offset && byte < offset + (end_byte - buffer.data())) {
+        next_byte = buffer.data() + (byte - offset);
+        bitbuf = 0;
+        bitcount = 0;
+        overrun = false;
+    }
+    else {
+        seekg(byte);
+    }
+    take(bit % 8);
+}
+
+bool ifbstream::at_end() noexcept {
+    if (bitcount >= 8) return false;
+    if (next_byte == end_byte) fill();
+    return next_byte == end_byte;
+}
+
+unsigned int ifbstream::next() {
+    return read(1);
+}
+
+int ifbstream::read(int count) {
+    int bits = take(count);
+    if (overrun) {
+        inflate::raise({shortfall(), tellbit()});
     }
 #ifdef DEBUG_DUMP_CODES
     std::bitset<16> bs(bits);
@@ -35,3 +156,38 @@ int ifbstream::read(int count) {
     return bits;
 }
 
+
+void ifbstream::read_bytes(char* s, std::streamsize count) {
+    if (take_bytes(s, count) < count) {
+        inflate::raise({shortfall(), tellbit()});
+    }
+}
+
+std::streamsize ifbstream::take_bytes(char* s, std::streamsize count)
+        noexcept {
+    std::streamsize wanted = count;
+    align();
+    for (; count > 0 && bitcount > 0; count--) {
+        *s++ = (char)bits(8);
+    }
+    if (count == 0) return wanted;
+
+    // the accumulator is empty, take the rest from the buffer
+    bitbuf = 0;
+    std::streamsize buffered = std::min<std::streamsize>(
+            count, end_byte - next_byte);
+    std::memcpy(s, next_byte, buffered);
+    next_byte += buffered;
+    s += buffered;
+    count -= buffered;
+    if (count == 0) return wanted;
+
+    // and then straight from the file
+    discard(offset + (end_byte - buffer.data()));
+    std::streamsize got = read_file(s, count);
+    offset += got;
+    if (got < count) {
+        overrun = true;
+    }
+    return wanted - count + got;
+}
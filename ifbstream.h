@@ -1,36 +1,182 @@
 #ifndef IFBSTREAM_H
 #define IFBSTREAM_H
 
+#include <cstdint>
+#include <cstring>
 #include <fstream>
+#include <memory>
 #include <string>
 #include <bitset>
+#include <vector>
+
+#include "cpudispatch.h"
+#include "asyncreader.h"
+#include "decodeerror.h"
 
 typedef char byte;
 
+// How the bit reader takes the low bits of its accumulator and shifts
+// them out, for loops compiled for other instruction sets to swap in
+struct plain_bits {
+    static inline uint64_t low(uint64_t word, int count) noexcept
+        {return word & ((uint64_t(1) << count) - 1);}
+    static inline uint64_t shift(uint64_t word, int count) noexcept
+        {return word >> count;}
+};
+
+#if defined(INFLATE_X86_DISPATCH) && defined(__x86_64__)
+#define INFLATE_BMI2_BITS
+/* BZHI, and the SHRX a function compiled for BMI2 makes of the shift:
+ * unlike shifts by CL, they take the count from any register and do not
+ * wait on the flags. Only for functions compiled for BMI2. */
+struct bmi2_bits {
+    static inline uint64_t low(uint64_t word, int count) noexcept {
+        uint64_t bits;
+        __asm__("bzhi %2, %1, %0"
+                : "=r"(bits) : "rm"(word), "r"(uint64_t(count)));
+        return bits;
+    }
+    static inline uint64_t shift(uint64_t word, int count) noexcept
+        {return word >> count;}
+};
+#endif
+
+// Reads a file bit by bit, least significant bit of each byte first.
+// The file is read in large chunks, and bits are taken from a 64 bit
+// accumulator that the decode loop can refill and peek at directly.
 class ifbstream {
     std::ifstream in;
-    byte buf;
-    size_t pos;
+    std::unique_ptr<asyncreader> ahead;  // reading through this instead
+    int fd;
+    const char* block;      // what is left of the block ahead last gave
+    size_t block_left;
+    bool fed;               // by reserve_input and commit_input alone
+    std::vector<unsigned char> buffer;
+    const unsigned char* next_byte;  // unread part of the buffer
+    const unsigned char* end_byte;
+    std::streamoff offset;  // of the start of the buffer in the file
+    uint64_t bitbuf;        // may hold unread bits above bitcount
+    int bitcount;
+    bool overrun;           // bits were wanted past the end of the file
 
     static constexpr const std::ios_base::openmode ibmode =
                     std::ios::in|std::ios::binary;
+    static const size_t buffer_size = 65536;
+
+    bool fill() noexcept;
+    void need(int count) noexcept;
+    std::streamsize read_file(char* s, std::streamsize count) noexcept;
 
 public:
     ifbstream(std::string fn)
         : in(fn, ibmode)
-        , pos(8) {}
+        , fd(-1)
+        , block_left(0)
+        , fed(false)
+        , buffer(buffer_size) {discard(0);}
 
     ifbstream(std::ifstream& in)
         : in(std::move(in))
-        , pos(8) {}
+        , fd(-1)
+        , block_left(0)
+        , fed(false)
+        , buffer(buffer_size) {discard(this->in.tellg());}
+
+    /* Reads fn with read_ahead reads of block_size in flight at once, see
+     * asyncreader, rather than one at a time as it is needed */
+    ifbstream(std::string fn, int read_ahead,
+            size_t block_size=asyncreader::default_block_size);
+    /* Reads only what it is given, for input that arrives piecemeal:
+     * up to n bytes are written to reserve_input(n) and handed over by
+     * commit_input, between reads. Everything from the byte being read
+     * on is kept until then, so seekbit can go back to it. */
+    ifbstream()
+        : fd(-1)
+        , block_left(0)
+        , fed(true)
+        , buffer(buffer_size) {discard(0);}
+    ~ifbstream();
 
+    // these throw at the end of the file
     unsigned int next();
     int read(int count);
+    // skips to the next byte boundary and reads whole bytes
+    void read_bytes(char* s, std::streamsize count);
+
+    /* The same without exceptions: past the end of the file, take reads
+     * zero bits, take_bytes reads short, and truncated() becomes true */
+    inline unsigned int take(int count) noexcept
+        {need(count); return bits(count);}
+    std::streamsize take_bytes(char* s, std::streamsize count) noexcept;
+    inline bool truncated() const noexcept {return overrun;}
+    // the errno of a read ahead that failed, 0 if none has
+    inline int error() const noexcept {return ahead ? ahead->error() : 0;}
+    // what running out of input was: the end of the file, or a failed read
+    inline inflate::error shortfall() const noexcept {return error()
+        ? inflate::error::read_failed : inflate::error::truncated;}
+    char* reserve_input(size_t n);
+    inline void commit_input(size_t n) noexcept {end_byte += n;}
+    // the bytes read from the file but not yet taken
+    inline size_t buffered() const noexcept {return end_byte - next_byte;}
+    // the bytes it holds, blocks read ahead included
+    inline size_t memory() const noexcept {return sizeof(*this)
+        + buffer.size() + (ahead ? ahead->memory() : 0);}
+
+    inline void open(const char* fn)
+        {close(); fed = false; in.open(fn, ibmode); discard(0);}
+    inline bool is_open() const {return ahead || in.is_open();}
+    // whether a byte aligned stream has nothing left to read
+    bool at_end() noexcept;
+    void close();
+    inline void reset() {seekg(0);}
+    void seekg(std::streampos p);
+    // to a bit offset, keeping the buffer when it is inside it
+    void seekbit(uint64_t bit) noexcept;
+    // skip to the next byte boundary
+    inline void align() noexcept {consume(bitcount % 8);}
+    inline std::streampos tellg() const
+        {return offset + (next_byte - buffer.data()) - bitcount / 8;}
+    // the number of bits read from the start of the file
+    inline uint64_t tellbit() const noexcept
+        {return (offset + (next_byte - buffer.data())) * 8 - bitcount;}
+
+    /* Unchecked access for the fast decode loop. refill() tops the
+     * accumulator up to at least 56 bits, and is only valid while
+     * can_refill(); peek and consume must stay within what it holds. */
+    inline bool can_refill() noexcept
+        {return end_byte - next_byte >= 8 || fill();}
+    inline void refill() noexcept {
+        uint64_t word;
+        std::memcpy(&word, next_byte, 8);
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+        word = __builtin_bswap64(word);
+#endif
+        bitbuf |= word << bitcount;
+        next_byte += (63 - bitcount) >> 3;
+        bitcount |= 56;
+    }
+    template <class Bits=plain_bits>
+    inline unsigned int peek(int count) const noexcept
+        {return Bits::low(bitbuf, count);}
+    template <class Bits=plain_bits>
+    inline void consume(int count) noexcept
+        {bitbuf = Bits::shift(bitbuf, count); bitcount -= count;}
+    template <class Bits=plain_bits>
+    inline unsigned int bits(int count) noexcept {
+        unsigned int b = peek<Bits>(count);
+        consume<Bits>(count);
+        return b;
+    }
 
-    inline void open(const char* fn) {in.open(fn, ibmode); pos=8;}
-    inline void close() {in.close();}
-    inline void reset() {in.seekg(0); pos=8;}
-    inline std::streampos tellg() {return in.tellg();}
+private:
+    // drops everything buffered, the file now being at p
+    inline void discard(std::streamoff p) noexcept {
+        offset = p;
+        next_byte = end_byte = buffer.data();
+        bitbuf = 0;
+        bitcount = 0;
+        overrun = false;
+    }
 };
 
 #endif
@@ -0,0 +1,189 @@
+#include "igzstream.h"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+
+#include "crc32.h"
+
+namespace {
+    // begins every igzstream checkpoint
+    const std::string igzstream_magic = "igzc";
+}
+
+inflate::igzstreambuf::igzstreambuf(std::string fn, size_t chunk_size)
+    : buf(inflate::max_buffer_size)
+    , area(chunk_size)
+    , bounds{0, 0, 0}
+    , decoded(0)
+    , member(0)
+    , crc(0)
+    , checking(true)
+    , ended(false) {
+    open(fn);
+    inf.reset(new inflate::inflater(*in, buf));
+    setg(area.data(), area.data(), area.data());
+}
+
+inflate::igzstreambuf::igzstreambuf(std::string fn,
+        const std::string& checkpoint, size_t chunk_size)
+    : buf(inflate::max_buffer_size)
+    , area(chunk_size)
+    , bounds{0, 0, 0}
+    , ended(false) {
+    using inflate::_UTIL::get_le;
+    open(fn);
+
+    size_t at = igzstream_magic.size();
+    crc = get_le(checkpoint, at, 4);
+    checking = get_le(checkpoint, at, 1);
+    decoded = get_le(checkpoint, at, 8);
+    member = get_le(checkpoint, at, 8);
+    size_t pending = get_le(checkpoint, at, 4);
+    if (checkpoint.compare(0, igzstream_magic.size(), igzstream_magic)
+            || at + pending > checkpoint.size() || pending > decoded
+            || member > decoded) {
+        inflate::raise({inflate::error::bad_checkpoint, 0});
+    }
+    area.resize(std::max(area.size(), pending));
+    std::memcpy(area.data(), checkpoint.data() + at, pending);
+    setg(area.data(), area.data(), area.data() + pending);
+
+    inf.reset(new inflate::inflater(*in, buf,
+                checkpoint.substr(at + pending)));
+    if (inf->failure().code == inflate::error::bad_checkpoint) {
+        inflate::raise(inf->failure());
+    }
+}
+
+void inflate::igzstreambuf::open(std::string fn) {
+    std::ifstream gz;
+    gz.exceptions(std::ios::badbit|std::ios::failbit);
+    gz.open(fn, std::ios::in|std::ios::binary);
+    inflate::read_gzip_header(gz, file);
+    in.reset(new ifbstream(gz));
+}
+
+bool inflate::igzstreambuf::finish() {
+/* At the end of a member's data, checks its trailer, and starts on the
+ * next member if one follows. Returns whether it did. */
+    if (ended || !inf->done()) return false;
+    ended = true;
+    inflate::error e = inflate::_UTIL::check_gzip_trailer(*in,
+            crc, decoded - member);
+    if (e == inflate::error::checksum_mismatch && !checking) {
+        e = inflate::error::none;   // bytes were discarded
+    }
+    if (e != inflate::error::none) {
+        inflate::raise({e, in->tellbit()});
+    }
+    if (in->at_end()) return false;
+    ended = false;
+
+    inflate::gzip_file next;
+    e = inflate::_UTIL::read_gzip_header(*in, next);
+    if (e != inflate::error::none) {
+        inflate::raise({e, in->tellbit()});
+    }
+    member = decoded;
+    crc = 0;
+    checking = true;
+    buf.reset();
+    inf.reset(new inflate::inflater(*in, buf));
+    // over the whole file, not each member
+    inf->set_limits(bounds, member);
+    return true;
+}
+
+void inflate::igzstreambuf::set_limits(const inflate::limits& bounds)
+        noexcept {
+    this->bounds = bounds;
+    inf->set_limits(bounds, member);
+}
+
+std::streambuf::int_type inflate::igzstreambuf::underflow() {
+    if (gptr() < egptr()) {
+        return traits_type::to_int_type(*gptr());
+    }
+    size_t count;
+    do {
+        count = inf->read(area.data(), area.size());
+        decoded += count;
+        if (checking) crc = inflate::crc32(crc, area.data(), count);
+    } while (count == 0 && finish());
+    setg(area.data(), area.data(), area.data() + count);
+    if (count == 0) {
+        return traits_type::eof();
+    }
+    return traits_type::to_int_type(*gptr());
+}
+
+std::streamsize inflate::igzstreambuf::xsgetn(char* s, std::streamsize n) {
+/* Hands over what is left of the get area, and then decodes directly
+ * into s while more than a chunk is wanted */
+    std::streamsize copied = std::min<std::streamsize>(n, egptr() - gptr());
+    std::memcpy(s, gptr(), copied);
+    gbump(copied);
+
+    while (n - copied >= (std::streamsize)area.size()) {
+        size_t count = inf->read(s + copied, n - copied);
+        decoded += count;
+        if (checking) crc = inflate::crc32(crc, s + copied, count);
+        copied += count;
+        if (count == 0 && !finish()) {
+            return copied;
+        }
+    }
+    if (copied < n) {
+        copied += std::streambuf::xsgetn(s + copied, n - copied);
+    }
+    return copied;
+}
+
+std::streamsize inflate::igzstreambuf::discard(std::streamsize n) {
+    std::streamsize buffered = std::min<std::streamsize>(
+            n, egptr() - gptr());
+    gbump(buffered);
+    std::streamsize skipped = buffered;
+    while (skipped < n) {
+        checking = false;  // the CRC-32 would need the bytes
+        uint64_t count = inf->discard(n - skipped);
+        decoded += count;
+        skipped += count;
+        if (inf->failure()) {
+            inflate::raise(inf->failure());
+        }
+        if (skipped < n && !finish()) break;
+    }
+    return skipped;
+}
+
+std::streambuf::pos_type inflate::igzstreambuf::seekoff(off_type off,
+        std::ios_base::seekdir way, std::ios_base::openmode which) {
+    if (!(which & std::ios_base::in) || way == std::ios_base::end) {
+        return pos_type(off_type(-1));
+    }
+    off_type target = way == std::ios_base::beg ? off : position() + off;
+    if (target < (off_type)position()) {
+        return pos_type(off_type(-1));
+    }
+    discard(target - position());
+    return pos_type(position());
+}
+
+std::streambuf::pos_type inflate::igzstreambuf::seekpos(pos_type pos,
+        std::ios_base::openmode which) {
+    return seekoff(off_type(pos), std::ios_base::beg, which);
+}
+
+std::string inflate::igzstreambuf::checkpoint() const {
+    using inflate::_UTIL::put_le;
+    std::string blob = igzstream_magic;
+    put_le(blob, crc, 4);
+    put_le(blob, checking, 1);
+    put_le(blob, decoded, 8);
+    put_le(blob, member, 8);
+    put_le(blob, egptr() - gptr(), 4);
+    blob.append(gptr(), egptr());
+    return blob + inf->checkpoint();
+}
@@ -0,0 +1,100 @@
+#ifndef IGZSTREAM_H
+#define IGZSTREAM_H
+
+#include <istream>
+#include <memory>
+#include <streambuf>
+#include <string>
+#include <vector>
+
+#include "inflate.h"
+#include "inflater.h"
+
+namespace inflate {
+    class igzstreambuf;
+    class igzstream;
+}
+
+
+// Reads a gzip file as a stream of decompressed bytes, those of every
+// member one after the other as gzip -d gives them. Each underflow
+// decodes the next chunk straight into the get area, so memory use is
+// bounded by the chunk and the window however large the file is. Each
+// member's CRC-32 trailer is checked at its end, unless bytes of it were
+// discarded.
+class inflate::igzstreambuf : public std::streambuf {
+public:
+    igzstreambuf(std::string fn, size_t chunk_size=65536);
+    // carries on from a checkpoint() of the same file
+    igzstreambuf(std::string fn, const std::string& checkpoint,
+            size_t chunk_size=65536);
+
+    // of the first member
+    inline const inflate::gzip_file& header() const {return file;}
+    // skips n bytes, decoding them into the window alone
+    std::streamsize discard(std::streamsize n);
+    /* The decoder's state as a blob to resume from later, with the
+     * running CRC-32 and the bytes decoded but not yet read */
+    std::string checkpoint() const;
+    // decoding fails past bounds, see limits
+    void set_limits(const inflate::limits& bounds) noexcept;
+    inline size_t memory() const noexcept
+        {return inf->memory() + area.size();}
+
+private:
+    virtual int_type underflow();
+    virtual std::streamsize xsgetn(char* s, std::streamsize n);
+    // forward only, by discarding up to the new position
+    virtual pos_type seekoff(off_type off, std::ios_base::seekdir way,
+            std::ios_base::openmode which=std::ios_base::in);
+    virtual pos_type seekpos(pos_type pos,
+            std::ios_base::openmode which=std::ios_base::in);
+    inline uint64_t position() const {return decoded - (egptr() - gptr());}
+    void open(std::string fn);
+    bool finish();
+
+    inflate::gzip_file file;
+    std::unique_ptr<ifbstream> in;
+    ringbuffer buf;
+    std::unique_ptr<inflate::inflater> inf;
+    std::vector<char> area;
+    inflate::limits bounds;
+    uint64_t decoded;  // bytes decoded so far, into area or not
+    uint64_t member;   // of them, before the current member
+    uint32_t crc;      // of the member's bytes decoded
+    bool checking;     // until bytes of the member are discarded
+    bool ended;        // the last trailer is checked
+};
+
+
+// Decoding errors are reported as from any istream: by badbit, or by
+// rethrowing when exceptions() includes badbit. seekg can only move
+// forward, decoding the bytes skipped without handing them over. For
+// long jobs, checkpoint() saves where reading got to, and an igzstream
+// constructed with it carries on from there.
+class inflate::igzstream : public std::istream {
+public:
+    igzstream(std::string fn, size_t chunk_size=65536)
+        : std::istream(&gbuf)
+        , gbuf(fn, chunk_size) {}
+
+    igzstream(std::string fn, const std::string& checkpoint,
+            size_t chunk_size=65536)
+        : std::istream(&gbuf)
+        , gbuf(fn, checkpoint, chunk_size) {}
+
+    inline const inflate::gzip_file& header() const {return gbuf.header();}
+    // resume from this by constructing with it
+    inline std::string checkpoint() const {return gbuf.checkpoint();}
+    /* Decoding fails past bounds, with a decode_error rethrown or badbit
+     * as for other errors */
+    inline void set_limits(const inflate::limits& bounds) noexcept
+        {gbuf.set_limits(bounds);}
+    // the bytes held by the decoder and its chunk
+    inline size_t memory() const noexcept {return gbuf.memory();}
+
+private:
+    igzstreambuf gbuf;
+};
+
+#endif
@@ -13,6 +13,11 @@
 #include "teestream.h"
 #include "ringbuffer.h"
 #include "ifbstream.h"
+#include "adler32.h"
+#include "crc32.h"
+#include "inflater.h"
+#include "decodercache.h"
+#include "decodeerror.h"
 
 
 namespace inflate { 
@@ -24,189 +29,158 @@ namespace inflate {
         const unsigned char comment = 0x10;
     }
 
+    namespace zflag {
+        const unsigned char fdict = 0x20;
+    }
+
     const std::vector<inflate::Range> fixedranges = {
         (inflate::Range){143, 8},
         (inflate::Range){255, 9},
         (inflate::Range){279, 7},
         (inflate::Range){287, 8}
     };
+    // 30 and 31 have codes but never occur
+    const std::vector<inflate::Range> fixeddistranges = {
+        (inflate::Range){31, 5}
+    };
 
     const int max_buffer_size=32768;
+    const int max_code_length = 15;
 }
 
 
 
-std::vector<int> inflate::_UTIL::count_by_bitlength(
-        const std::vector<inflate::Range>& ranges) {
-/* Calculates the length of each canonical huffman code range */
-    std::vector<int> lengths;
-    int max_bit_length;
-    std::vector<inflate::Range> diff;
-
-    // max = max(ranges, lambda x, y: x.bit_length < y.bit_length)
-    max_bit_length = std::max_element(ranges.begin(), ranges.end(),
-            [](const inflate::Range& x, const inflate::Range& y) {
-                return x.bit_length < y.bit_length; }
-        )->bit_length;
-
-    // count the lengths of each range
-    // take the difference between previous and current range ends
-    // diff = map(zip(ranges, [0] + ranges[:-1]), lambda x, y: x.end - y.end)
-    std::adjacent_difference(ranges.begin(), ranges.end(),
-            back_inserter(diff), 
-            [](const inflate::Range& p, const inflate::Range& c) {
-                return (inflate::Range){p.end - c.end, p.bit_length};}
-        );
-    diff[0].end += 1; // 0 is a symbol
-    // collect range lengths into bins by code bit_length
-    std::fill_n(back_inserter(lengths), max_bit_length + 1, 0);
-    for(auto& drange : diff) {
-        lengths[drange.bit_length] += drange.end;
-    }
-    return lengths;
+inflate::dictionary::dictionary(std::string bytes)
+    : data(std::make_shared<const std::string>(std::move(bytes)))
+    , id(inflate::adler32(1, data->data(), data->size())) {
 }
 
 
-inflate::Decoder inflate::build_decoder(
-        const std::vector<inflate::Range>& ranges) {
-/* Build a decoder from the canonical huffman code ranges */
-    inflate::Decoder decoder;
-    if (ranges.empty()) return decoder;
-
-    std::vector<int> numrows;
-    std::vector<inflate::Code>nextcodes;
-    std::vector<inflate::_UTIL::Coderow> codebook;
-
-    numrows = inflate::_UTIL::count_by_bitlength(ranges);
-
-    // determine starting codes for each bit length
-    nextcodes.push_back(0); // start at 0
-    // acc = 0
-    // for num in numrows[1:]:
-    //      acc = (acc + num) << 1
-    //      nextcodes.append(acc if num else 0)
-    int acc = 0;
-    for(auto i=numrows.begin()+1, e=numrows.end(); i<e; i++) {
-        nextcodes.push_back(*i ? acc : 0);
-        acc = (acc + *i) << 1;
-    }
-
-    // populate the codebook
-    // codebook = map(zip(diff, ranges), 
-    //                lambda d, r: zip(d*[r.code], range(r.end-d, r)
-    //                                             if r.code != 0 else 0))
-    codebook.reserve(ranges.back().end);
-    auto appendtobook = back_inserter(codebook);
-    for(const auto& range : ranges) {
-        unsigned int len = range.bit_length;
-        std::generate_n(appendtobook, range.end + 1 - codebook.size(),
-                [&nextcodes, &len]() { 
-                return inflate::_UTIL::Coderow(
-                        {len, (len ? nextcodes[len]++ : 0)} ); 
-                }
-            );
-    }
-
-#ifdef DEBUG_DUMP_CODES
-    std::cout << "Ranges: ";
-    for(auto& range : ranges) {
-        std::cout << range.end << ':' << range.bit_length << ", ";
+void inflate::build_decoder(inflate::Decoder& decoder,
+        const uint8_t* lengths, int count) noexcept {
+/* Assigns the canonical codes for the code lengths of count symbols, as
+ * RFC 1951 3.2.2 sets out, and fills the decoder's tables with them */
+    int bl_count[max_code_length + 1] = {0};
+    int next_code[max_code_length + 1];
+    for (int symbol = 0; symbol < count; symbol++) {
+        if (lengths[symbol] <= max_code_length) {
+            bl_count[lengths[symbol]]++;
+        }
     }
-    std::cout << std::endl;
-    for(int i=0; i < codebook.size(); i++) {
-        std::cout << i << ": ";
-        for(int pos=codebook[i].bit_length-1; pos>=0; pos--)
-            std::cout << ((codebook[i].code >> pos ) & 1);
-        std::cout << std::endl;
+    bl_count[0] = 0;
+    int code = 0;
+    int longest = 0;
+    long left = 1;  // codes left unused, 0 when complete
+    for (int bits = 1; bits <= max_code_length; bits++) {
+        code = (code + bl_count[bits - 1]) << 1;
+        next_code[bits] = code;
+        left = (left << 1) - bl_count[bits];
+        if (bl_count[bits]) longest = bits;
     }
-#endif
-    
-    // invert codebook into decoder
-    inflate::Symbol symbol = 0;
-    for (auto& row : codebook) {
-        if (row.bit_length < 1) {  // skip empty lines
-            symbol++;
-        }
-        else {
-            decoder.insert(row.bit_length, row.code, symbol++);
+
+    decoder.clear(longest, left == 0);
+    for (int symbol = 0; symbol < count; symbol++) {
+        int length = lengths[symbol];
+        if (length > 0 && length <= max_code_length) {
+            decoder.insert(length, next_code[length]++, symbol);
         }
     }
-    return decoder;
 }
 
-template <class InputIterator>
-std::vector<inflate::Range> inflate::_UTIL::group_into_ranges(
-        InputIterator first, InputIterator last) {
-/* Groups vectors of code lengths into canonical huffman ranges */
-    std::vector<inflate::Range> ranges;
-
-    // collapse into ranges (possibly unnecessary?)
-    // may use Eric Niebler's range lib group_by in future STL
-    InputIterator it = first;
-    for(int i = 0; it < last; i++, it++) {
-        if (*it == *(it+1) && it < last-1) {
-            continue;  // only push when code bit length changes or at end
+inflate::Decoder inflate::build_decoder(
+        const std::vector<inflate::Range>& ranges) {
+/* Build a decoder from the canonical huffman code ranges */
+    inflate::Decoder decoder;
+    uint8_t lengths[inflate::Decoder::max_symbols];
+    int count = 0;
+    for (const auto& range : ranges) {
+        while (count <= range.end && count < inflate::Decoder::max_symbols) {
+            lengths[count++] = range.bit_length;
         }
-        ranges.emplace_back(
-                (inflate::Range){i, *it});
     }
-    return ranges;
+    inflate::build_decoder(decoder, lengths, count);
+    return decoder;
 }
 
-
-std::vector<inflate::Range> inflate::_UTIL::read_preheader(ifbstream& in){
-    int hclen;
-    hclen = in.read(4);
-    std::vector<unsigned int> preheader_lengths(19, 0);  // input
-    std::vector<inflate::Range> preheader_ranges;  // output
-    static const int preheader_offsets[] = {  // according to spec
-    16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15 };
-
-#ifdef DEBUG_INFGEN_OUTPUT_D
-    std::cout << hclen + 4 << std::endl;
-#endif
-
-#ifdef DEBUG_DUMP_CODES
-    std::cout << "--------------------------Preheader Codes--------------------------------------" << std::endl;
-#endif
-
-    // read in offsets
-    for(int i=0; i<(hclen + 4); i++){
-        preheader_lengths[ preheader_offsets[i] ] = in.read(3);
+bool inflate::_UTIL::complete_code(const uint8_t* lengths, int count,
+        bool lone_code) noexcept {
+/* Whether the lengths of count symbols describe a complete prefix code,
+ * as zlib requires. Litlen and distance codes may instead have one 1 bit
+ * code, or for distances none at all. */
+    int bl_count[max_code_length + 1] = {0};
+    for (int symbol = 0; symbol < count; symbol++) {
+        if (lengths[symbol] > max_code_length) return false;
+        bl_count[lengths[symbol]]++;
     }
-
-    preheader_ranges = inflate::_UTIL::group_into_ranges(
-            preheader_lengths.begin(), preheader_lengths.end());
-#ifdef DEBUG_INFGEN_OUTPUT_D
-    int i = 0;
-    for(auto& range : preheader_ranges){
-        if(!range.bit_length) {
-            i = range.end + 1;
-            continue;
-        }
-        for(i; i <= range.end; i++) {
-            std::cout << "code ";
-            std::cout << i << ' ' << range.bit_length << std::endl;
-        }
+    long left = 1;
+    bool longer = false;  // than one bit
+    for (int length = 1; length <= max_code_length; length++) {
+        left = (left << 1) - bl_count[length];
+        if (left < 0) return false;
+        if (length > 1 && bl_count[length]) longer = true;
     }
-#endif
-    return preheader_ranges;
+    return left == 0 || (lone_code && !longer);
 }
 
-
 std::pair<inflate::Decoder, inflate::Decoder>
 inflate::read_deflate_header(ifbstream& in) {
-    std::vector<inflate::Range> preheader_ranges;
-    inflate::Decoder preheader_dec;
-    inflate::Decoder literals_dec, distance_dec;
+    std::pair<inflate::Decoder, inflate::Decoder> decoders;
+    inflate::error e = inflate::read_deflate_header(in,
+            decoders.first, decoders.second);
+    if (e != inflate::error::none) {
+        inflate::raise({e, in.tellbit()});
+    }
+    return decoders;
+}
 
-    unsigned int bit_length;
-    std::vector<unsigned int> lengths;
-    auto into_lengths = back_inserter(lengths);
+inflate::error inflate::read_deflate_header(ifbstream& in,
+        inflate::Decoder& literals_dec,
+        inflate::Decoder& distance_dec) noexcept {
+/* Reads the code lengths into a fixed array and builds the decoders in
+ * place from them, allocating nothing */
+    uint8_t lengths[inflate::_UTIL::max_code_lengths];
+    int literals, distances;
+    inflate::error e = inflate::_UTIL::read_code_lengths(in, literals_dec,
+            lengths, literals, distances);
+    if (e != inflate::error::none) {
+        return e;
+    }
+    inflate::build_decoder(literals_dec, lengths, literals);
+    inflate::build_decoder(distance_dec, lengths + literals, distances);
+    return inflate::error::none;
+}
+
+inflate::error inflate::read_deflate_header(ifbstream& in,
+        inflate::decoder_cache& cache, inflate::Decoder& scratch,
+        const inflate::Decoder*& literals_dec,
+        const inflate::Decoder*& distance_dec) noexcept {
+    uint8_t lengths[inflate::_UTIL::max_code_lengths];
+    int literals, distances;
+    inflate::error e = inflate::_UTIL::read_code_lengths(in, scratch,
+            lengths, literals, distances);
+    if (e != inflate::error::none) {
+        return e;
+    }
+    cache.get(lengths, literals, distances, literals_dec, distance_dec);
+    return inflate::error::none;
+}
 
-    int hlit, hdist;
-    hlit = in.read(5);
-    hdist = in.read(5);
+inflate::error inflate::_UTIL::read_code_lengths(ifbstream& in,
+        inflate::Decoder& preheader_dec, uint8_t* lengths,
+        int& literals, int& distances) noexcept {
+    static const int preheader_offsets[] = {  // according to spec
+    16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15 };
+    uint8_t preheader_lengths[19] = {0};
+    int count = 0;
+
+    int hlit, hdist, hclen;
+    hlit = in.take(5);
+    hdist = in.take(5);
+    if (hlit > 29 || hdist > 29) {  // 286 and 30 codes at most
+        return in.truncated() ? in.shortfall()
+            : inflate::error::invalid_code_lengths;
+    }
+    int total = hlit + hdist + 258;
 
 #ifdef DEBUG_INFGEN_OUTPUT_D
     std::cout << "count " << hlit + 257 << ' ' << hdist + 1 << ' ';
@@ -216,138 +190,122 @@ inflate::read_deflate_header(ifbstream& in) {
     #endif
 #endif
 
-    lengths.reserve(hlit + hdist + 258);
-
-    preheader_ranges = inflate::_UTIL::read_preheader(in);
-    preheader_dec = build_decoder(preheader_ranges);
-
+    hclen = in.take(4);
+#ifdef DEBUG_INFGEN_OUTPUT_D
+    std::cout << hclen + 4 << std::endl;
+#endif
+    for (int i = 0; i < hclen + 4; i++) {
+        preheader_lengths[preheader_offsets[i]] = in.take(3);
+#ifdef DEBUG_INFGEN_OUTPUT_D
+        std::cout << "code " << preheader_offsets[i] << ' '
+            << (int)preheader_lengths[preheader_offsets[i]] << std::endl;
+#endif
+    }
+    if (!inflate::_UTIL::complete_code(preheader_lengths, 19, false)) {
+        return in.truncated() ? in.shortfall()
+            : inflate::error::invalid_code_lengths;
+    }
+    inflate::build_decoder(preheader_dec, preheader_lengths, 19);
 
-    for(inflate::Symbol symbol=0; symbol < (hlit + hdist + 258); symbol++){
-        try {
-            bit_length = preheader_dec.read_out(in);
-        }
-        catch (std::invalid_argument& e) {
-            throw std::invalid_argument(
-                    "Preheader Code Invalid: unindexed code");
-        }
-        if (bit_length > 15) {  // repeat symbol
+    while (count < total) {
+        int code = preheader_dec.read_out(in);
+        if (code < 0 || in.truncated()) break;
+        if (code > 15) {  // repeat symbol
 #ifdef DEBUG_INFGEN_OUTPUT_D
             if (lens) { lens = false; std::cout << std::endl; }
 #endif
-            int repeat;
-            switch(bit_length) {
+            int repeat = 0;  // 16-18 are all a preheader decodes past 15
+            uint8_t repeated = 0;
+            switch(code) {
             case 16:
-                repeat = in.read(2) + 3;
-                std::fill_n(into_lengths, repeat, lengths.back());
+                if (count == 0) {  // nothing to repeat
+                    return inflate::error::invalid_code_lengths;
+                }
+                repeat = in.take(2) + 3;
+                repeated = lengths[count - 1];
 #ifdef DEBUG_INFGEN_OUTPUT_D
                 std::cout << "repeat " << repeat << std::endl;
 #endif
                 break;
             case 17:
-                repeat = in.read(3) + 3;
-                std::fill_n(into_lengths, repeat, 0);
+                repeat = in.take(3) + 3;
 #ifdef DEBUG_INFGEN_OUTPUT_D
                 std::cout << "zeros " << repeat << std::endl;
 #endif
                 break;
             case 18:
-                repeat = in.read(7) + 11;
-                std::fill_n(into_lengths, repeat, 0);
+                repeat = in.take(7) + 11;
 #ifdef DEBUG_INFGEN_OUTPUT_D
                 std::cout << "zeros " << repeat << std::endl;
 #endif
                 break;
-            default:
-                throw std::runtime_error(
-                        "Preheader Decoder Invalid: symbol too large");
             }
-            symbol += repeat - 1;
+            std::fill_n(lengths + count, repeat, repeated);
+            count += repeat;
         }
-        else { // read_out output guaranteed > 0
-            into_lengths = bit_length;
+        else {
+            lengths[count++] = code;
 #ifdef DEBUG_INFGEN_OUTPUT_D
             if (!lens) { lens = true; std::cout << "lens"; }
-            std::cout << " " << bit_length;
+            std::cout << " " << code;
 #endif
         }
     }
 #if defined(DEBUG_DUMP_CODES) || defined(DEBUG_INFGEN_OUTPUT_D)
     std::cout << std::endl;
 #endif
-    auto literals_ranges = inflate::_UTIL::group_into_ranges(
-            lengths.begin(), lengths.begin() + (hlit + 257));
-    
-#ifdef DEBUG_DUMP_CODES
-    std::cout << "----------------------------Literal Codes--------------------------------------" << std::endl;
-#endif
-
-#ifdef DEBUG_INFGEN_OUTPUT
-    int i = 0;
-    for(auto& range : literals_ranges){
-        if(!range.bit_length) {
-            i = range.end + 1;
-            continue;
-        }
-        for(i; i <= range.end; i++) {
-    #ifdef DEBUG_INFGEN_OUTPUT_D
-            std::cout << "! ";
-    #endif
-            std::cout << "litlen ";
-            std::cout << i << ' ' << range.bit_length << std::endl;
-        }
+    if (in.truncated()) {
+        return in.shortfall();
+    }
+    // an unindexed code, or repeats running past the end
+    if (count != total) {
+        return inflate::error::invalid_code_lengths;
+    }
+    if (lengths[256] == 0) {  // no end of block
+        return inflate::error::invalid_code_lengths;
+    }
+    const uint8_t* distance_lengths = lengths + hlit + 257;
+    if (!inflate::_UTIL::complete_code(lengths, hlit + 257, true)
+            || !inflate::_UTIL::complete_code(distance_lengths,
+                hdist + 1, true)) {
+        return inflate::error::invalid_code_lengths;
     }
-#endif
-
-    literals_dec = inflate::build_decoder(literals_ranges);
-
-    auto distance_ranges = inflate::_UTIL::group_into_ranges(
-            lengths.begin() + (hlit + 257), lengths.end());
-
-#ifdef DEBUG_DUMP_CODES
-    std::cout << "---------------------------Distance Codes--------------------------------------" << std::endl;
-#endif
 
 #ifdef DEBUG_INFGEN_OUTPUT
-    i = 0;
-    for(auto& range : distance_ranges){
-        if(!range.bit_length) {
-            i = range.end + 1;
-            continue;
-        }
-        for(i; i <= range.end; i++) {
+    for (int i = 0; i < total; i++) {
+        if (lengths[i] == 0) continue;
     #ifdef DEBUG_INFGEN_OUTPUT_D
-            std::cout << "! ";
+        std::cout << "! ";
     #endif
-            std::cout << "dist ";
-            std::cout << i << ' ' << range.bit_length << std::endl;
+        if (i < hlit + 257) {
+            std::cout << "litlen " << i;
+        }
+        else {
+            std::cout << "dist " << i - (hlit + 257);
         }
+        std::cout << ' ' << (int)lengths[i] << std::endl;
     }
 #endif
 
-    distance_dec = inflate::build_decoder(distance_ranges);
-    
-    return std::make_pair(literals_dec, distance_dec);
+    literals = hlit + 257;
+    distances = hdist + 1;
+    return inflate::error::none;
 }
 
 #ifdef DEBUG_INFGEN_OUTPUT
-void inflate::_UTIL::teeprint::operator()(teestream& out,
-        ringbuffer& buf, char symbol) {
+void inflate::_UTIL::teeprint::operator()(char symbol) {
     if (symbol < 32) {  // unprintable
         if (!wasliteral) {  // new literal
             std::cout << "literal ";
             wasliteral = true;
             quoted = false;
             std::cout << (int)(unsigned char)symbol;
-            buf << symbol;
-
         }
         else {  // more literals
             if (quoted) std::cout << std::endl << "literal";
             std::cout << ' ';
             quoted = false;
             std::cout << (int)(unsigned char)symbol;
-            buf << symbol;
-
         }
     }
     else {  // printable
@@ -355,19 +313,36 @@ void inflate::_UTIL::teeprint::operator()(teestream& out,
             wasliteral = true;
             quoted = true;
             std::cout << "literal '";
-            out << symbol;
+            std::cout << symbol;
         }
         else {  // more literals
             if (!quoted) {
                 std::cout << " '";
                 quoted = true;
             }
-            out << symbol;
+            std::cout << symbol;
         }
     }
 }
 #endif
 
+uint64_t inflate::_UTIL::drain(inflate::inflater& inf,
+        std::ostream& output) {
+/* Pushes everything the inflater decodes to output, a block at a time,
+ * returning how much that was */
+    char block[65536];
+    size_t count;
+    uint64_t total = 0;
+    do {
+        count = inf.read(block, sizeof(block));
+        total += count;
+#ifndef DEBUG_INFGEN_OUTPUT  // infgen output replaces the data
+        output.write(block, count);
+#endif
+    } while (count == sizeof(block));
+    return total;
+}
+
 ringbuffer& inflate::inflate_block(ifbstream& in,
         std::ostream& output/*=std::cout*/, bool fixedcode/*=false*/) {
     ringbuffer buf(inflate::max_buffer_size);
@@ -378,127 +353,117 @@ ringbuffer& inflate::inflate_block(ifbstream& in,
         ringbuffer& buf,
         std::ostream& output/*=std::cout*/, 
         bool fixedcode/*=false*/) {
-    teestream teeout(output, buf);
+    inflate::inflater inf(in, buf, fixedcode ? 0x01 : 0x02);
+    inflate::_UTIL::drain(inf, output);
+    return buf;
+}
+
+void inflate::inflate_stored(ifbstream& in, ringbuffer& buf,
+        std::ostream& output/*=std::cout*/) {
+    inflate::inflater inf(in, buf, 0x00);
+    inflate::_UTIL::drain(inf, output);
+}
+
+uint64_t inflate::inflate_blocks(ifbstream& in, ringbuffer& buf,
+        std::ostream& output/*=std::cout*/) {
+    inflate::inflater inf(in, buf);
+    return inflate::_UTIL::drain(inf, output);
+}
 
-    static const int extra_length_addend[] = {
-        11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 
-        51, 59, 67, 83, 99, 115, 131, 163, 195, 227
-    };
-    static const int extra_dist_addend[] = {
-        4, 6, 8, 12, 16, 24, 32, 48, 64, 96, 128,
-        192, 256, 384, 512, 768, 1024, 1536, 2048,
-        3072, 4096, 6144, 8192, 12288, 16384, 24576
-    };
-    inflate::Decoder literals_dec, distance_dec;
 
-    if (!fixedcode) {
-        std::tie(literals_dec, distance_dec) = read_deflate_header(in);
+inflate::error inflate::_UTIL::read_gzip_header(ifbstream& in,
+        inflate::gzip_file& file) noexcept {
+/* read_gzip_header for a member following another, after its trailer */
+    unsigned char* header = reinterpret_cast<unsigned char*>(&file.header);
+    for (size_t i = 0; i < sizeof(gzip_header); i++) {
+        header[i] = in.take(8);
     }
-    else {
-        literals_dec = build_decoder(inflate::fixedranges);
-        distance_dec;
+    if (in.truncated()) return in.shortfall();
+    if (file.header.id[0] != 0x1f || file.header.id[1] != 0x8b) {
+        return inflate::error::not_gzip;
     }
-#ifdef DEBUG_INFGEN_OUTPUT
-    inflate::_UTIL::teeprint infgen_print;    
-#endif
-
-    while(true) {
-        inflate::Symbol symbol = literals_dec.read_out(in);
-        if(symbol < 256) {
-#ifdef DEBUG_INFGEN_OUTPUT
-            infgen_print(teeout, buf, symbol);
-#else
-            teeout << (char)symbol;
-#endif
-        }
-        else if (symbol == 256) { // stop symbol is 256
-            break;
+    if (file.header.compression_method != 8) {
+        return inflate::error::bad_method;
+    }
+    if (file.header.flags & flag::extra) {
+        file.xlen = in.take(16);
+        file.extra = nullptr;  // not kept
+        for (int i = 0; i < file.xlen && !in.truncated(); i++) {
+            in.take(8);
         }
-        else if (symbol < 286) {  // backpointer (3.2.5):
-            int length, distance;
-            if (symbol < 265) {             // length of match
-                length = symbol - 254;      // 257-264 -> 3-10
-            }
-            else if (symbol < 285) {
-                int extra_bits = in.read((symbol - 261) / 4);
-                length = extra_bits         // 265-284 -> 11-257
-                           + extra_length_addend[symbol - 265];
-            }
-            else {                          // symbol == 285
-                length = 258;
-            }
-
-            // read the distance code
-            if (distance_dec.empty()) {
-                distance = in.read(5);
-            }
-            else {
-                distance = distance_dec.read_out(in);
-            }
+    }
+    if (file.header.flags & flag::fname) {
+        char c;
+        while ((c = in.take(8)) && !in.truncated()) file.fname += c;
+    }
+    if (file.header.flags & flag::comment) {
+        char c;
+        while ((c = in.take(8)) && !in.truncated()) file.fcomment += c;
+    }
+    if (file.header.flags & flag::hcrc) {
+        file.crc16 = in.take(16);
+    }
+    return in.truncated() ? in.shortfall() : inflate::error::none;
+}
 
-            if (distance < 30) {
-                if (distance > 3) {             // 4-29 -> 4-32767
-                    int extra_dist = in.read((distance - 2) / 2 );
-                    distance = extra_dist
-                        + extra_dist_addend[distance - 4];
-                }
-                ++distance; // 0-32767 -> 1-32768
+void inflate::_UTIL::put_le(std::string& blob, uint64_t value, int bytes) {
+    for (int i = 0; i < bytes; i++) {
+        blob += (char)(value >> (8 * i));
+    }
+}
 
-#ifndef DEBUG_INFGEN_OUTPUT
-                std::cout << buf.readfrom(length, distance);
-#else
-    #ifdef DEBUG_DUMP_CODES
-                 std::cout << "match " << length << ' ' << distance;
-    #else
-                if (infgen_print.wasliteral) std::cout << std::endl;
-                infgen_print.wasliteral = false;
-                std::cout << "match "
-                    << length << ' ' << distance << std::endl;
-    #endif
-#endif
-            }
-            else {
-                throw std::invalid_argument(
-                    "Error decoding block: Invalid distance symbol");
-            }
-        }
-        else {
-            throw std::invalid_argument(
-                    "Error decoding block: Invalid literal symbol");
+uint64_t inflate::_UTIL::get_le(const std::string& blob, size_t& at,
+        int bytes) noexcept {
+    uint64_t value = 0;
+    for (int i = 0; i < bytes; i++, at++) {
+        if (at < blob.size()) {
+            value |= uint64_t((unsigned char)blob[at]) << (8 * i);
         }
     }
+    return value;
+}
 
-    return buf;
+inflate::error inflate::_UTIL::check_gzip_trailer(ifbstream& in,
+        uint32_t crc, uint64_t size) noexcept {
+/* Reads the CRC-32 and the size modulo 2^32 that end a gzip member,
+ * both little-endian, and checks them against the data */
+    in.align();
+    uint32_t expected_crc = in.take(16);
+    expected_crc |= uint32_t(in.take(16)) << 16;
+    uint32_t expected_size = in.take(16);
+    expected_size |= uint32_t(in.take(16)) << 16;
+    if (in.truncated()) {
+        return in.shortfall();
+    }
+    if (crc != expected_crc || uint32_t(size) != expected_size) {
+        return inflate::error::checksum_mismatch;
+    }
+    return inflate::error::none;
 }
 
 
-void inflate::gunzip(std::string fn, std::ostream& output/*=std::cout*/) {
-    inflate::gzip_file file;
-    std::ifstream in;
-#ifdef DEBUG_INFGEN_OUTPUT
-    std::cout << "! infgen 2.2 output" << std::endl << '!' << std::endl;
-#endif
-
+void inflate::read_gzip_header(std::ifstream& in,
+        inflate::gzip_file& file) {
     // may throw the following
     in.exceptions(std::ios::badbit|std::ios::failbit);
 
-    in.open(fn, std::ios::in|std::ios::binary);
     in.read((char*)&file.header, sizeof(gzip_header));
     // 1f8b signifies a gzip file
     if (file.header.id[0] != 0x1f || file.header.id[1] != 0x8b) {
-        throw std::invalid_argument("Not in gzip format");
+        inflate::raise({inflate::error::not_gzip, 0});
     }
 #ifdef DEBUG_INFGEN_OUTPUT
         std::cout << "gzip" << std::endl << '!' << std::endl;
 #endif
     if (file.header.compression_method != 8) {
-        throw std::invalid_argument("Compression Method not 8");
+        inflate::raise({inflate::error::bad_method, 0});
     }
     if (file.header.flags & flag::extra) {
-        // TODO spec seems to indicate that this is little-endian;
-        // htons for big-endian machines?
-        in.read(reinterpret_cast<char*>(file.xlen), 2);
-        in.read((char*)file.extra, file.xlen);
+        unsigned char xlen[2];  // little-endian
+        in.read(reinterpret_cast<char*>(xlen), 2);
+        file.xlen = xlen[0] | (xlen[1] << 8);
+        file.extra = nullptr;  // not kept
+        in.ignore(file.xlen);
     }
     if (file.header.flags & flag::fname) {
         std::getline(in, file.fname, '\0');
@@ -507,54 +472,386 @@ void inflate::gunzip(std::string fn, std::ostream& output/*=std::cout*/) {
         std::getline(in, file.fcomment, '\0');
     }
     if (file.header.flags & flag::hcrc) {
-        in.read(reinterpret_cast<char*>(file.crc16), 2);
+        unsigned char crc16[2];
+        in.read(reinterpret_cast<char*>(crc16), 2);
+        file.crc16 = crc16[0] | (crc16[1] << 8);
     }
 
     // no longer throws exceptions
     in.exceptions(std::ios::goodbit);
+}
 
-    int last_block;
-    unsigned char block_format;
 
-    ifbstream bin(in);
-    ringbuffer buf(inflate::max_buffer_size);
-    do {
-        last_block = bin.next();
+void inflate::gunzip(std::string fn, std::ostream& output/*=std::cout*/) {
+    inflate::gunzip(fn, output, inflate::limits{0, 0, 0});
+}
+
+void inflate::gunzip(std::string fn, std::ostream& output,
+        const inflate::limits& bounds) {
+    inflate::gzip_file file;
+    std::ifstream in;
 #ifdef DEBUG_INFGEN_OUTPUT
-        if(last_block) std::cout << "last" << std::endl;
+    std::cout << "! infgen 2.2 output" << std::endl << '!' << std::endl;
 #endif
-        block_format = bin.read(2);
-        switch(block_format) {
-            case 0x00:
-                // TODO
-                std::cerr << "Uncompressed block type not supported"
-                    << std::endl;
-                throw std::logic_error(
-                        "Uncompressed block type not implemented");
-                break;
-            case 0x01:
-                inflate_block(bin, buf, output, true); // fixedcode = true
-                break;
-            case 0x02:
+
+    in.exceptions(std::ios::badbit|std::ios::failbit);
+    in.open(fn, std::ios::in|std::ios::binary);
+    inflate::read_gzip_header(in, file);
+
+    ifbstream bin(in);
+    ringbuffer buf(inflate::max_buffer_size);
+    uint64_t decoded = 0;
+    // every member of the file, as gzip -d does
+    while (true) {
+        inflate::crc32stream crc;
+        teestream checked(output, crc);
+        inflate::inflater inf(bin, buf);
+        // over the whole file, not each member
+        inf.set_limits(bounds, decoded);
+        uint64_t size = inflate::_UTIL::drain(inf, checked);
+        checked.flush();
+        decoded += size;
 #ifdef DEBUG_INFGEN_OUTPUT
-                std::cout << "dynamic" << std::endl;
+        break;
+#else
+        inflate::error e = inflate::_UTIL::check_gzip_trailer(bin,
+                crc.checksum(), size);
+        if (e != inflate::error::none) {
+            inflate::raise({e, bin.tellbit()});
+        }
+        if (bin.at_end()) break;
+        e = inflate::_UTIL::read_gzip_header(bin, file);
+        if (e != inflate::error::none) {
+            inflate::raise({e, bin.tellbit()});
+        }
+        buf.reset();
 #endif
-                inflate_block(bin, buf, output);
+    }
+}
+
+
+inflate::verification inflate::gunzip_verify(std::string fn,
+        int cached_headers/*=0*/, int read_ahead/*=0*/) {
+    return inflate::gunzip_verify(fn, inflate::limits{0, 0, 0},
+            cached_headers, read_ahead);
+}
+
+inflate::verification inflate::gunzip_verify(std::string fn,
+        const inflate::limits& bounds, int cached_headers/*=0*/,
+        int read_ahead/*=0*/) {
+    inflate::verification result =
+        {{inflate::error::none, 0}, 0, 0, 0, 0, 0};
+    std::unique_ptr<ifbstream> input(read_ahead > 0
+            ? new ifbstream(fn, read_ahead) : new ifbstream(fn));
+    ifbstream& in = *input;
+    if (!in.is_open()) {
+        result.status.code = inflate::error::cannot_open;
+        return result;
+    }
+    ringbuffer buf(inflate::max_buffer_size);
+    char block[65536];
+    std::unique_ptr<inflate::decoder_cache> cache;
+    if (cached_headers > 0) {
+        cache.reset(new inflate::decoder_cache(cached_headers));
+    }
+
+    // every member of the file, as gzip -t does
+    do {
+        inflate::gzip_file file;
+        inflate::error e = inflate::_UTIL::read_gzip_header(in, file);
+        if (e != inflate::error::none) {
+            result.status = {e, in.tellbit()};
+            break;
+        }
+        buf.reset();
+        inflate::inflater inf(in, buf);
+        inf.use_cache(cache.get());
+        // over the whole file, not each member
+        inf.set_limits(bounds, result.uncompressed_size);
+        uint32_t crc = 0;
+        uint64_t size = 0;
+        size_t count;
+        while ((count = inf.decode(block, sizeof(block))) > 0) {
+            crc = inflate::crc32(crc, block, count);
+            size += count;
+        }
+        result.uncompressed_size += size;
+        if (inf.failure()) {
+            result.status = inf.failure();
+            break;
+        }
+        e = inflate::_UTIL::check_gzip_trailer(in, crc, size);
+        if (e != inflate::error::none) {
+            result.status = {e, in.tellbit()};
+            break;
+        }
+        result.members++;
+    } while (!in.at_end());
+
+    result.compressed_size = in.tellg();
+    if (cache) {
+        result.cache_hits = cache->hits();
+        result.cache_misses = cache->misses();
+    }
+    return result;
+}
+
+
+std::vector<inflate::member> inflate::scan(std::string fn) {
+    std::vector<inflate::member> members;
+    ifbstream in(fn);
+    if (!in.is_open()) {
+        inflate::raise({inflate::error::cannot_open, 0});
+    }
+    ringbuffer unused(inflate::max_buffer_size);  // skip leaves it alone
+
+    do {
+        inflate::member m;
+        inflate::gzip_file file;
+        m.offset = in.tellg();
+        inflate::error e = inflate::_UTIL::read_gzip_header(in, file);
+        if (e != inflate::error::none) {
+            inflate::raise({e, in.tellbit()});
+        }
+        m.data_offset = in.tellg();
+        m.fname = file.fname;
+
+        inflate::inflater inf(in, unused);
+        m.size = inf.skip();
+        if (inf.failure()) {
+            inflate::raise(inf.failure());
+        }
+
+        in.align();
+        m.crc = in.take(16);
+        m.crc |= uint32_t(in.take(16)) << 16;
+        m.isize = in.take(16);
+        m.isize |= uint32_t(in.take(16)) << 16;
+        if (in.truncated()) {
+            inflate::raise({in.shortfall(), in.tellbit()});
+        }
+        if (m.isize != uint32_t(m.size)) {
+            inflate::raise({inflate::error::checksum_mismatch, in.tellbit()});
+        }
+        m.end = in.tellg();
+        members.push_back(m);
+    } while (!in.at_end());
+
+    return members;
+}
+
+
+std::vector<inflate::damage> inflate::gunzip_recover(std::string fn,
+        std::ostream& output/*=std::cout*/, bool resync/*=false*/) {
+    inflate::gzip_file file;
+    std::ifstream in;
+    in.exceptions(std::ios::badbit|std::ios::failbit);
+    in.open(fn, std::ios::in|std::ios::binary);
+    inflate::read_gzip_header(in, file);
+
+    ifbstream bin(in);
+    std::unique_ptr<ringbuffer> buf(new ringbuffer(inflate::max_buffer_size));
+    std::unique_ptr<inflate::inflater> inf(
+            new inflate::inflater(bin, *buf));
+    std::vector<inflate::damage> damages;
+    std::vector<char> block(65536);
+    uint64_t written = 0;
+    uint64_t member_start = 0;  // written before the member
+    uint32_t crc = 0;
+    bool damaged = false;       // so its trailer cannot match
+
+    while (true) {
+        size_t count = inf->decode(block.data(), block.size());
+        output.write(block.data(), count);
+        crc = inflate::crc32(crc, block.data(), count);
+        written += count;
+
+        if (inf->done()) {
+            // on to the next member, as gunzip does
+            inflate::error e = inflate::_UTIL::check_gzip_trailer(bin, crc,
+                    written - member_start);
+            if (e == inflate::error::checksum_mismatch && damaged) {
+                e = inflate::error::none;   // already reported
+            }
+            if (e != inflate::error::none) {
+                damages.push_back({{e, bin.tellbit()}, written, 0});
+            }
+            if (bin.truncated() || bin.at_end()) break;
+            if (e != inflate::error::none) {
+                damages.back().resumed_at = bin.tellbit();
+            }
+            e = inflate::_UTIL::read_gzip_header(bin, file);
+            if (e != inflate::error::none) {
+                damages.push_back({{e, bin.tellbit()}, written, 0});
                 break;
-            default:
-                std::cerr << "Unsupported block type "
-                    << int(block_format) << std::endl;
-                throw std::invalid_argument("Invalid block type");
+            }
+            buf.reset(new ringbuffer(inflate::max_buffer_size));
+            inf.reset(new inflate::inflater(bin, *buf));
+            member_start = written;
+            crc = 0;
+            damaged = false;
+            continue;
         }
+        if (!inf->failure()) continue;
+
+        damaged = true;
+        damages.push_back({inf->failure(), written, 0});
+        if (!resync || bin.truncated()) {
+            break;
+        }
+        // carry on with the window as it is, padded to full size with
+        // zeros so that matches reaching into what was lost still copy
+        std::string window = buf->str();
+        window.insert(0, inflate::max_buffer_size - window.size(), '\0');
+        buf.reset(new ringbuffer(inflate::max_buffer_size,
+                    std::make_shared<const std::string>(window)));
+
+        // the next block cannot start before the one that failed
+        uint64_t next = inflate::_UTIL::find_block(bin, *buf,
+                inf->block_offset() + 1);
+        if (next == 0) break;
+        damages.back().resumed_at = next;
+        bin.seekbit(next);
+        inf.reset(new inflate::inflater(bin, *buf));
+    }
+    output.flush();
+    return damages;
+}
+
+uint64_t inflate::_UTIL::find_block(ifbstream& in, ringbuffer& window,
+        uint64_t from) {
+/* Scans bit by bit for a stored or dynamic block that decodes whole,
+ * returning its bit offset, or 0 if there is none. Candidates are
+ * decoded into the window and it is reset after each, so it must be
+ * empty with the bytes before the block as its dictionary. Fixed blocks
+ * are too easily mistaken for, and are not looked for. */
+    std::vector<char> scratch(65536);
+
+    for (uint64_t at = from; ; at++) {
+        in.seekbit(at);
+        in.take(1);
+        int block_format = in.take(2);
+        if (in.truncated()) return 0;
+
+        // cheap checks first, most positions fail these
+        if (block_format == 0x00) {
+            in.align();
+            int length = in.take(16);
+            if ((length ^ in.take(16)) != 0xffff) continue;
+        }
+        else if (block_format == 0x02) {
+            if (!inflate::_UTIL::plausible_header(in)) continue;
+        }
+        else {
+            continue;
+        }
+
+        in.seekbit(at + 3);
+        inflate::inflater inf(in, window, block_format);
+        while (!inf.done() && !inf.failure()) {
+            inf.decode(scratch.data(), scratch.size());
+        }
+        window.reset();
+        if (inf.done()) return at;
+    }
+}
+
+bool inflate::_UTIL::plausible_header(ifbstream& in) noexcept {
+/* Whether the bits after a dynamic block type could be its header:
+ * sensible code counts and a complete code length code */
+    int hlit = in.take(5);
+    int hdist = in.take(5);
+    int hclen = in.take(4);
+    if (hlit > 29 || hdist > 29) return false;
+
+    int kraft = 0;  // in units of 2^-7, complete at 128
+    for (int i = 0; i < hclen + 4; i++) {
+        int length = in.take(3);
+        if (length) kraft += 128 >> length;
+    }
+    return kraft == 128 && !in.truncated();
+}
+
+
+void inflate::uncompress(std::string fn,
+        std::ostream& output/*=std::cout*/) {
+    inflate::uncompress(fn, output, inflate::dictionary());
+}
+
+void inflate::uncompress(std::string fn, std::ostream& output,
+        const inflate::dictionary& dict) {
+    inflate::zlib_header header;
+    std::ifstream in;
 #ifdef DEBUG_INFGEN_OUTPUT
-        std::cout << std::endl << "end" << std::endl << '!' << std::endl;
+    std::cout << "! infgen 2.2 output" << std::endl << '!' << std::endl;
 #endif
 
-#ifdef DEBUG_DUMP_CODES
-        std::cout << "offset=" << bin.tellg() << std::endl;
+    // may throw the following
+    in.exceptions(std::ios::badbit|std::ios::failbit);
+
+    in.open(fn, std::ios::in|std::ios::binary);
+    in.read((char*)&header, sizeof(zlib_header));
+    // the header as a big-endian 16 bit number is a multiple of 31
+    if ((header.cmf * 256 + header.flg) % 31 != 0) {
+        inflate::raise({inflate::error::not_zlib, 0});
+    }
+#ifdef DEBUG_INFGEN_OUTPUT
+        std::cout << "zlib" << std::endl << '!' << std::endl;
 #endif
-    } while (!last_block);
+    if ((header.cmf & 0x0f) != 8) {
+        inflate::raise({inflate::error::bad_method, 0});
+    }
+    if ((header.cmf >> 4) > 7) {  // log2(window size) - 8
+        inflate::raise({inflate::error::bad_window, 0});
+    }
+    if (header.flg & zflag::fdict) {
+        unsigned char dictid[4];  // big-endian
+        in.read(reinterpret_cast<char*>(dictid), 4);
+        uint32_t id = (dictid[0] << 24) | (dictid[1] << 16)
+            | (dictid[2] << 8) | dictid[3];
+        if (!dict.data) {
+            inflate::raise({inflate::error::dictionary_required, 0});
+        }
+        if (id != dict.id) {
+            inflate::raise({inflate::error::dictionary_mismatch, 0});
+        }
+    }
 
-    return;
+    // no longer throws exceptions
+    in.exceptions(std::ios::goodbit);
+
+    ifbstream bin(in);
+    ringbuffer buf(inflate::max_buffer_size, dict.data);
+    inflate::adler32stream adler;
+    teestream checked(output, adler);
+    inflate_blocks(bin, buf, checked);
+    checked.flush();
+
+    // trailer is the big-endian adler-32 of the uncompressed data
+    bin.align();
+    uint32_t expected = 0;
+    for (int i = 0; i < 4; i++) {
+        expected = (expected << 8) | bin.read(8);
+    }
+    if (adler.checksum() != expected) {
+        inflate::raise({inflate::error::checksum_mismatch, bin.tellbit()});
+    }
+}
+
+
+void inflate::inflate_raw(std::string fn,
+        std::ostream& output/*=std::cout*/) {
+    inflate::inflate_raw(fn, output, inflate::dictionary());
 }
 
+void inflate::inflate_raw(std::string fn, std::ostream& output,
+        const inflate::dictionary& dict) {
+    std::ifstream in;
+    in.exceptions(std::ios::badbit|std::ios::failbit);
+    in.open(fn, std::ios::in|std::ios::binary);
+    in.exceptions(std::ios::goodbit);
+
+    ifbstream bin(in);
+    ringbuffer buf(inflate::max_buffer_size, dict.data);
+    inflate_blocks(bin, buf, output);
+}
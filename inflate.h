@@ -3,17 +3,21 @@
 
 #include <vector>
 #include <iostream>
+#include <memory>
+#include <cstdint>
 #include "ifbstream.h"
 #include "ringbuffer.h"
-
-#ifdef DEBUG_INFGEN_OUTPUT
-#include <sstream>
-#include "teestream.h"
-#endif
+#include "decodeerror.h"
 
 namespace inflate {
     struct gzip_header;
     struct gzip_file;
+    struct zlib_header;
+    struct dictionary;
+    struct damage;
+    struct verification;
+    struct member;
+    struct limits;
 
     struct Node;
     struct Range;
@@ -23,11 +27,30 @@ namespace inflate {
     class Decodertype;
     class huffmantree;
     typedef huffmantree Decoder;
+    class inflater;
+    class decoder_cache;
+
+    extern const std::vector<Range> fixedranges;
+    extern const std::vector<Range> fixeddistranges;
+    extern const int max_buffer_size;  // the deflate window, 32K
 
     Decoder build_decoder(const std::vector<Range>&);
+    /* Builds decoder in place from the code lengths of count symbols,
+     * 0 for symbols without a code, without allocating */
+    void build_decoder(Decoder& decoder, const uint8_t* lengths,
+            int count) noexcept;
     Symbol read_out(Decoder huffman_tree, ifbstream& in);
 
     std::pair<Decoder, Decoder> read_deflate_header(ifbstream& in);
+    // the same, returning what was wrong instead of throwing
+    error read_deflate_header(ifbstream& in,
+            Decoder& literals, Decoder& distances) noexcept;
+    /* The same again, taking the decoders from cache, built there unless
+     * it has seen the same code lengths before. scratch is overwritten
+     * with the code of the code lengths. */
+    error read_deflate_header(ifbstream& in, decoder_cache& cache,
+            Decoder& scratch, const Decoder*& literals,
+            const Decoder*& distances) noexcept;
 
     /* Decodes a inflate block into the output ostream, 
      * also returning the last max_buffer_size bytes as a stream,
@@ -40,19 +63,90 @@ namespace inflate {
             std::ostream& output=std::cout,
             bool fixedcode=false);
 
+    /* Decodes a stored (uncompressed) block, the block header bits
+     * have already been read */
+    void inflate_stored(ifbstream& in, ringbuffer& buf,
+            std::ostream& output=std::cout);
+
+    /* Decodes a raw deflate stream (RFC 1951) block by block, up to and
+     * including the block with the final bit set, returning the number
+     * of bytes decoded. This is the engine shared by all of the container
+     * formats below. */
+    uint64_t inflate_blocks(ifbstream& in, ringbuffer& buf,
+            std::ostream& output=std::cout);
+
+    /* Reads a gzip header (RFC 1952) from in, leaving the stream
+     * at the start of the deflate data */
+    void read_gzip_header(std::ifstream& in, gzip_file& file);
+
+    // gzip container (RFC 1952), every member of it in turn, verifying
+    // each CRC-32 trailer
     void gunzip(std::string fn, std::ostream& output=std::cout);
+    // the same within bounds, throwing decode_error past them
+    void gunzip(std::string fn, std::ostream& output,
+            const limits& bounds);
+    /* Checks a gzip file is intact, as gzip -t does, without writing the
+     * data anywhere. Never throws, the result says what was wrong. With
+     * cached_headers, the codes of that many dynamic block headers are
+     * kept for reuse by later blocks and members with the same header.
+     * With read_ahead, that many reads of the file are kept in flight. */
+    verification gunzip_verify(std::string fn, int cached_headers=0,
+            int read_ahead=0);
+    verification gunzip_verify(std::string fn, const limits& bounds,
+            int cached_headers=0, int read_ahead=0);
+    /* Lists the members of a gzip file without decoding their data: each
+     * one's blocks are walked for their codes alone, writing nothing, to
+     * find where it ends and its trailer is. Throws as gunzip does. */
+    std::vector<member> scan(std::string fn);
+    /* Decodes what it can of a damaged gzip file: writes all output up to
+     * where decoding fails and reports where that was, rather than
+     * throwing. With resync it then looks for the next block that decodes
+     * whole and carries on from there, for as long as the input lasts.
+     * Every member is decoded in turn, a bad trailer being reported as
+     * damage too, resumed at the member after it. */
+    std::vector<damage> gunzip_recover(std::string fn,
+            std::ostream& output=std::cout, bool resync=false);
+    // zlib container (RFC 1950), verifying the Adler-32 trailer
+    void uncompress(std::string fn, std::ostream& output=std::cout);
+    void uncompress(std::string fn, std::ostream& output,
+            const dictionary& dict);
+    // headerless deflate data, e.g. ZIP entries
+    void inflate_raw(std::string fn, std::ostream& output=std::cout);
+    void inflate_raw(std::string fn, std::ostream& output,
+            const dictionary& dict);
 
     namespace _UTIL {
         struct Coderow;
 
-        std::vector<int> count_by_bitlength(
-                const std::vector<inflate::Range>& ranges);
+        // literal/length and distance code lengths, with room for the
+        // longest repeat running past the end, which is an error
+        const int max_code_lengths = 286 + 30 + 138;
+        /* Reads the code lengths of a dynamic block header into lengths,
+         * literals of them for the literal/length code followed by
+         * distances for the distance code, checking each code is
+         * complete. Builds the code of the code lengths in preheader. */
+        inflate::error read_code_lengths(ifbstream& in,
+                inflate::Decoder& preheader, uint8_t* lengths,
+                int& literals, int& distances) noexcept;
+        bool complete_code(const uint8_t* lengths, int count,
+                bool lone_code) noexcept;
+
+        uint64_t drain(inflate::inflater& inf, std::ostream& output);
+
+        inflate::error read_gzip_header(ifbstream& in,
+                inflate::gzip_file& file) noexcept;
+        inflate::error check_gzip_trailer(ifbstream& in,
+                uint32_t crc, uint64_t size) noexcept;
 
-        template <class InputIterator>
-        std::vector<inflate::Range> group_into_ranges(
-                InputIterator first, InputIterator last);
+        // little-endian fields of checkpoints, get reads zeros past the
+        // end but still advances at, for checking once at the end
+        void put_le(std::string& blob, uint64_t value, int bytes);
+        uint64_t get_le(const std::string& blob, size_t& at,
+                int bytes) noexcept;
 
-        std::vector<inflate::Range> read_preheader(ifbstream& in);
+        uint64_t find_block(ifbstream& in, ringbuffer& window,
+                uint64_t from);
+        bool plausible_header(ifbstream& in) noexcept;
 
         class teeprint; // for debugging purposes
     }
@@ -68,6 +162,60 @@ struct inflate::gzip_header {
   unsigned char os;
 };
 
+struct inflate::zlib_header {
+  unsigned char cmf;  // compression method and info
+  unsigned char flg;  // flags and check bits
+};
+
+// A preset dictionary (RFC 1950 2.2), primes the window before decoding.
+// Copies share the bytes, so one dictionary may serve many streams.
+struct inflate::dictionary {
+    dictionary() : id(1) {}
+    dictionary(std::string bytes);
+
+    std::shared_ptr<const std::string> data;  // null when not set
+    uint32_t id;  // Adler-32 of the bytes, as stored in zlib headers
+};
+
+// Where gunzip_recover had to stop, and where it went on from
+struct inflate::damage {
+    inflate::status failure;  // what was wrong, at which input bit offset
+    uint64_t output_offset;   // bytes decoded before it
+    uint64_t resumed_at;      // input bit offset of the next good block,
+                              // 0 if decoding stopped here
+};
+
+/* Bounds on what decoding an untrusted stream may take, each 0 for none.
+ * The inflater checks them at block boundaries and after each run of its
+ * fast loop, so output may go past max_output by up to 64K before
+ * decoding fails with error::output_limit, ratio_limit or memory_limit. */
+struct inflate::limits {
+    uint64_t max_output;  // bytes decoded in all
+    uint64_t max_ratio;   // bytes decoded per byte read, past the first 4K
+    uint64_t max_memory;  // bytes of window, buffers and tables held
+};
+
+// What gunzip_verify made of a file
+struct inflate::verification {
+    inflate::status status;      // code none if the file is intact
+    int members;                 // intact gzip members
+    uint64_t compressed_size;    // bytes read
+    uint64_t uncompressed_size;  // bytes decoded
+    uint64_t cache_hits;         // dynamic headers whose codes were cached
+    uint64_t cache_misses;       // and those built, 0 without a cache
+};
+
+// A member of a gzip file, as found by scan
+struct inflate::member {
+    uint64_t offset;       // of its header, in bytes
+    uint64_t data_offset;  // of its deflate stream
+    uint64_t end;          // just past its trailer
+    uint64_t size;         // decoded size, counted from the codes
+    uint32_t crc;          // CRC-32 of the data, from the trailer
+    uint32_t isize;        // size modulo 2^32, from the trailer
+    std::string fname;
+};
+
 struct inflate::gzip_file
 {
   gzip_header header;
@@ -97,7 +245,8 @@ struct inflate::_UTIL::Coderow {  // Essentially a named std::pair
 class inflate::Decodertype {
 public:
     virtual void insert(int codelen, inflate::Code, inflate::Symbol) = 0;
-    virtual inflate::Symbol read_out(ifbstream& in) const = 0;
+    // the next symbol in, or -1 where in holds no code
+    virtual inflate::Symbol read_out(ifbstream& in) const noexcept = 0;
     virtual inline bool empty() const noexcept = 0;
     virtual std::string str() = 0;
 };
@@ -110,7 +259,7 @@ class inflate::_UTIL::teeprint {
 public:
     bool wasliteral = false;
     bool quoted = true;
-    void operator()(teestream& out, ringbuffer& buf, char c);
+    void operator()(char c);
 };
 #endif
 
@@ -0,0 +1,628 @@
+#include "inflater.h"
+#include "cpudispatch.h"
+#include "decodercache.h"
+#include "matchcopy.h"
+
+#include <algorithm>
+#include <cstring>
+#include <tuple>
+
+namespace {
+    const int extra_length_addend[] = {
+        11, 13, 15, 17, 19, 23, 27, 31, 35, 43,
+        51, 59, 67, 83, 99, 115, 131, 163, 195, 227
+    };
+    const int extra_dist_addend[] = {
+        4, 6, 8, 12, 16, 24, 32, 48, 64, 96, 128,
+        192, 256, 384, 512, 768, 1024, 1536, 2048,
+        3072, 4096, 6144, 8192, 12288, 16384, 24576
+    };
+
+    // room for the longest match, so the fast loop need not check
+    const size_t fast_margin = 258;
+    // the most the window can reserve at once
+    const size_t fast_window = 65536;
+
+    // the codes of fixed blocks, built the first time they are needed
+    const inflate::Decoder& fixed_literals() {
+        static const inflate::Decoder decoder =
+            inflate::build_decoder(inflate::fixedranges);
+        return decoder;
+    }
+    const inflate::Decoder& fixed_distances() {
+        static const inflate::Decoder decoder =
+            inflate::build_decoder(inflate::fixeddistranges);
+        return decoder;
+    }
+
+    // output any stream may have before its ratio to input is held to
+    const uint64_t ratio_allowance = 4096;
+
+    // begins every inflater checkpoint
+    const std::string inflater_magic = "infc";
+
+#ifdef INFLATE_BMI2_BITS
+    // the avx2 tier brings BMI2 with it
+    bool use_bmi2() noexcept {
+        static const bool bmi2 =
+            inflate::cpu_selected() >= inflate::cpu_tier::avx2;
+        return bmi2;
+    }
+#endif
+}
+
+
+inflate::inflater::inflater(ifbstream& in, ringbuffer& buf)
+    : in(in)
+    , buf(buf)
+    , state(blockstart)
+    , last_block(false)
+    , block_start(in.tellbit())
+    , literals_dec(&dynamic_literals)
+    , distance_dec(&dynamic_distances)
+    , cache(nullptr)
+    , bounds({0, 0, 0})
+    , limited(false)
+    , output_start(buf.written())
+    , input_start(0)
+    , lookahead(0)
+    , stored_left(0)
+    , match_length(0)
+    , match_distance(0)
+    , err({inflate::error::none, 0}) {
+}
+
+inflate::inflater::inflater(ifbstream& in, ringbuffer& buf,
+        int block_format)
+    : inflater(in, buf) {
+    last_block = true;
+    block_start -= 3;
+    begin_block(block_format);
+}
+
+inflate::inflater::inflater(ifbstream& in, ringbuffer& buf,
+        const std::string& checkpoint)
+    : inflater(in, buf) {
+    using inflate::_UTIL::get_le;
+    size_t at = inflater_magic.size();
+    mode saved = (mode)get_le(checkpoint, at, 1);
+    bool saved_last = get_le(checkpoint, at, 1);
+    uint64_t saved_start = get_le(checkpoint, at, 8);
+    uint64_t position = get_le(checkpoint, at, 8);
+    int saved_stored = get_le(checkpoint, at, 4);
+    int saved_length = get_le(checkpoint, at, 4);
+    int saved_distance = get_le(checkpoint, at, 4);
+    inflate::status saved_err;
+    saved_err.code = (inflate::error)get_le(checkpoint, at, 1);
+    saved_err.bit_offset = get_le(checkpoint, at, 8);
+    uint64_t written = get_le(checkpoint, at, 8);
+    size_t window = get_le(checkpoint, at, 4);
+    if (checkpoint.compare(0, inflater_magic.size(), inflater_magic)
+            || saved > failed || at + window != checkpoint.size()
+            || window > (size_t)buf.size() || window > written) {
+        fail(inflate::error::bad_checkpoint);
+        return;
+    }
+    buf.resume(checkpoint.substr(at), written);
+
+    // the codes come back from reading the block header again
+    if (saved == stored || saved == codes) {
+        in.seekbit(saved_start);
+        in.take(1);
+        begin_block(in.take(2));
+        if (state != saved) {
+            fail(inflate::error::bad_checkpoint);
+            return;
+        }
+    }
+    state = saved;
+    last_block = saved_last;
+    block_start = saved_start;
+    stored_left = saved_stored;
+    match_length = saved_length;
+    match_distance = saved_distance;
+    err = saved_err;
+    in.seekbit(position);
+}
+
+std::string inflate::inflater::checkpoint() const {
+    using inflate::_UTIL::put_le;
+    std::string blob = inflater_magic;
+    put_le(blob, state, 1);
+    put_le(blob, last_block, 1);
+    put_le(blob, block_start, 8);
+    put_le(blob, in.tellbit(), 8);
+    put_le(blob, stored_left, 4);
+    put_le(blob, match_length, 4);
+    put_le(blob, match_distance, 4);
+    put_le(blob, (int)err.code, 1);
+    put_le(blob, err.bit_offset, 8);
+    put_le(blob, buf.written(), 8);
+    std::string window = buf.str();
+    put_le(blob, window.size(), 4);
+    return blob + window;
+}
+
+
+void inflate::inflater::set_limits(const inflate::limits& bounds,
+        uint64_t decoded_before/*=0*/, uint64_t input_start/*=0*/) noexcept {
+    this->bounds = bounds;
+    this->input_start = input_start;
+    limited = bounds.max_output || bounds.max_ratio || bounds.max_memory;
+    output_start = buf.written() - decoded_before;
+    if (state != failed) within_limits();
+}
+
+size_t inflate::inflater::memory() const noexcept {
+    return sizeof(*this) + buf.memory() + in.memory()
+        + (cache ? cache->memory() : 0);
+}
+
+bool inflate::inflater::check_limits() noexcept {
+/* Fails decoding if it went past its bounds. Cheap enough for every
+ * block and every run of the fast loop, which is at most 64K. */
+    uint64_t output = buf.written() - output_start;
+    uint64_t input = in.tellbit() / 8 - input_start;
+    inflate::error e = inflate::error::none;
+    if (bounds.max_output && output > bounds.max_output) {
+        e = inflate::error::output_limit;
+    }
+    if (e == inflate::error::none && bounds.max_ratio
+            && output > ratio_allowance) {
+        uint64_t allowed = input > UINT64_MAX / bounds.max_ratio
+            ? UINT64_MAX : input * bounds.max_ratio;
+        if (output - ratio_allowance > allowed) {
+            e = inflate::error::ratio_limit;
+        }
+    }
+    if (e == inflate::error::none && bounds.max_memory
+            && memory() > bounds.max_memory) {
+        e = inflate::error::memory_limit;
+    }
+    if (e == inflate::error::none) return true;
+    err = {e, in.tellbit()};
+    state = failed;
+    return false;
+}
+
+
+void inflate::inflater::next_block() noexcept {
+    if (!within_limits()) return;
+    block_start = in.tellbit();
+    last_block = in.take(1);
+#ifdef DEBUG_INFGEN_OUTPUT
+    if(last_block) std::cout << "last" << std::endl;
+#endif
+    int block_format = in.take(2);
+    if (in.truncated()) {
+        fail(inflate::error::truncated);
+        return;
+    }
+    begin_block(block_format);
+}
+
+void inflate::inflater::begin_block(int block_format) {
+    switch(block_format) {
+        case 0x00:
+            in.align();
+            stored_left = in.take(16);
+            if ((stored_left ^ in.take(16)) != 0xffff) {
+                fail(inflate::error::stored_length_mismatch);
+                return;
+            }
+#ifdef DEBUG_INFGEN_OUTPUT
+            std::cout << "stored" << std::endl;
+#endif
+            state = stored;
+            break;
+        case 0x01:
+            literals_dec = &fixed_literals();
+            distance_dec = &fixed_distances();
+            state = codes;
+            break;
+        case 0x02: {
+#ifdef DEBUG_INFGEN_OUTPUT
+            std::cout << "dynamic" << std::endl;
+#endif
+            inflate::error e;
+            if (cache) {
+                e = read_deflate_header(in, *cache, dynamic_literals,
+                        literals_dec, distance_dec);
+            }
+            else {
+                e = read_deflate_header(in,
+                        dynamic_literals, dynamic_distances);
+                literals_dec = &dynamic_literals;
+                distance_dec = &dynamic_distances;
+            }
+            if (e != inflate::error::none) {
+                fail(e);
+                return;
+            }
+            state = codes;
+            break;
+        }
+        default:
+            fail(inflate::error::invalid_block_type);
+    }
+}
+
+void inflate::inflater::end_block() {
+#ifdef DEBUG_INFGEN_OUTPUT
+    std::cout << std::endl << "end" << std::endl << '!' << std::endl;
+#endif
+#ifdef DEBUG_DUMP_CODES
+    std::cout << "offset=" << in.tellg() << std::endl;
+#endif
+    state = last_block ? finished : blockstart;
+}
+
+void inflate::inflater::fail(inflate::error e) noexcept {
+/* Stops decoding, blaming running out of input over whatever the
+ * zero bits read past the end looked like */
+    if (in.truncated()) e = in.shortfall();
+    err = {e, in.tellbit()};
+    state = failed;
+}
+
+
+size_t inflate::inflater::read(char* out, size_t n) {
+    size_t count = decode(out, n);
+    if (state == failed) {
+        inflate::raise(err);
+    }
+    return count;
+}
+
+
+size_t inflate::inflater::decode(char* out, size_t n) noexcept {
+    size_t produced = 0;
+    std::streambuf* window = buf.rdbuf();
+
+    while (produced < n) {
+        switch (state) {
+        case finished:
+        case failed:
+            return produced;
+
+        case blockstart:
+            if (in.buffered() < lookahead) return produced;
+            next_block();
+            break;
+
+        case stored: {
+            int count = std::min<size_t>(stored_left, n - produced);
+            count = in.take_bytes(out + produced, count);
+            window->sputn(out + produced, count);
+            produced += count;
+            stored_left -= count;
+            if (in.truncated()) fail(inflate::error::truncated);
+            else if (stored_left == 0) end_block();
+            else within_limits();
+            break;
+        }
+
+        case codes: {
+            if (match_length > 0) {  // resume a suspended match
+                int count = std::min<size_t>(match_length, n - produced);
+                const char* match = buf.copy(count, match_distance);
+                std::memcpy(out + produced, match, count);
+                produced += count;
+                match_length -= count;
+                break;
+            }
+#if !defined(DEBUG_INFGEN_OUTPUT) && !defined(DEBUG_DUMP_CODES)
+            if (n - produced >= fast_margin && in.can_refill()) {
+                produced += decode_fast(out + produced, n - produced);
+                if (state == codes) within_limits();
+                break;
+            }
+#endif
+
+            inflate::Symbol symbol = literals_dec->read_out(in);
+            if (symbol < 0 || in.truncated()) {
+                fail(inflate::error::invalid_code);
+            }
+            else if(symbol < 256) {
+#ifdef DEBUG_INFGEN_OUTPUT
+                infgen_print(symbol);
+#endif
+                out[produced++] = (char)symbol;
+                window->sputc((char)symbol);
+            }
+            else if (symbol == 256) { // stop symbol is 256
+                end_block();
+            }
+            else if (symbol < 286) {  // backpointer (3.2.5):
+                int length, distance;
+                if (symbol < 265) {             // length of match
+                    length = symbol - 254;      // 257-264 -> 3-10
+                }
+                else if (symbol < 285) {
+                    int extra_bits = in.take((symbol - 261) / 4);
+                    length = extra_bits         // 265-284 -> 11-257
+                               + extra_length_addend[symbol - 265];
+                }
+                else {                          // symbol == 285
+                    length = 258;
+                }
+
+                // read the distance code
+                distance = distance_dec->read_out(in);
+                if (distance < 0) {
+                    fail(inflate::error::invalid_code);
+                    break;
+                }
+                if (distance >= 30) {
+                    fail(inflate::error::invalid_distance);
+                    break;
+                }
+                if (distance > 3) {             // 4-29 -> 4-32767
+                    int extra_dist = in.take((distance - 2) / 2 );
+                    distance = extra_dist
+                        + extra_dist_addend[distance - 4];
+                }
+                ++distance; // 0-32767 -> 1-32768
+                if (in.truncated() || !buf.reaches(distance)) {
+                    fail(inflate::error::distance_too_far);
+                    break;
+                }
+
+#ifdef DEBUG_INFGEN_OUTPUT
+    #ifdef DEBUG_DUMP_CODES
+                std::cout << "match " << length << ' ' << distance;
+    #else
+                if (infgen_print.wasliteral) std::cout << std::endl;
+                infgen_print.wasliteral = false;
+                std::cout << "match "
+                    << length << ' ' << distance << std::endl;
+    #endif
+#endif
+                // copied by the next turn of the loop
+                match_length = length;
+                match_distance = distance;
+            }
+            else {
+                fail(inflate::error::invalid_literal);
+            }
+            break;
+        }
+        }
+    }
+    return produced;
+}
+
+
+template <class Bits>
+#ifdef __GNUC__
+__attribute__((always_inline))
+#endif
+inline size_t inflate::inflater::decode_fast_loop(char* out, size_t n)
+        noexcept {
+/* The inner loop of decode, for while the input holds a whole symbol and
+ * the output has room for a whole match, so neither is checked per
+ * symbol. Decodes straight into the window, copying out at the end
+ * unless out is null.
+ * Returns at the end of the block, at a match the window cannot copy
+ * without the dictionary, or near the end of either buffer. */
+    size_t limit = std::min(n, fast_window);
+    char* const begin = buf.reserve(limit);
+    char* const last = begin + limit - fast_margin;
+    char* dst = begin;
+    uint64_t written = buf.written();
+
+    while (dst <= last && in.can_refill()) {
+        in.refill();    // enough for the longest length and distance
+        inflate::Symbol symbol = literals_dec->read_fast<Bits>(in);
+        if (symbol < 0) {
+            fail(inflate::error::invalid_code);
+            break;
+        }
+        if (symbol < 256) {
+            *dst++ = (char)symbol;
+            continue;
+        }
+        if (symbol == 256) {
+            end_block();
+            break;
+        }
+        if (symbol >= 286) {
+            fail(inflate::error::invalid_literal);
+            break;
+        }
+
+        int length;
+        if (symbol < 265) {
+            length = symbol - 254;
+        }
+        else if (symbol < 285) {
+            length = in.bits<Bits>((symbol - 261) / 4)
+                + extra_length_addend[symbol - 265];
+        }
+        else {
+            length = 258;
+        }
+
+        int distance = distance_dec->read_fast<Bits>(in);
+        if (distance < 0) {
+            fail(inflate::error::invalid_code);
+            break;
+        }
+        if (distance >= 30) {
+            fail(inflate::error::invalid_distance);
+            break;
+        }
+        if (distance > 3) {
+            distance = in.bits<Bits>((distance - 2) / 2)
+                + extra_dist_addend[distance - 4];
+        }
+        ++distance;
+
+        if (distance > buf.size()
+                || (uint64_t)distance > written + (dst - begin)) {
+            // into the dictionary or out of range, see below
+            match_length = length;
+            match_distance = distance;
+            break;
+        }
+        inflate::copy_match(dst, distance, length);
+        dst += length;
+    }
+
+    size_t count = dst - begin;
+    buf.commit(count);
+    if (out != nullptr) {
+        std::memcpy(out, begin, count);
+    }
+    if (match_length > 0 && !buf.reaches(match_distance)) {
+        match_length = 0;
+        fail(inflate::error::distance_too_far);
+    }
+    return count;
+}
+
+size_t inflate::inflater::decode_fast_plain(char* out, size_t n) noexcept {
+    return decode_fast_loop<plain_bits>(out, n);
+}
+
+#ifdef INFLATE_BMI2_BITS
+__attribute__((target("bmi2")))
+size_t inflate::inflater::decode_fast_bmi2(char* out, size_t n) noexcept {
+/* The same loop, taking the bits of codes and of their extra bits with
+ * BZHI and SHRX */
+    return decode_fast_loop<bmi2_bits>(out, n);
+}
+#endif
+
+size_t inflate::inflater::decode_fast(char* out, size_t n) noexcept {
+#ifdef INFLATE_BMI2_BITS
+    if (use_bmi2()) return decode_fast_bmi2(out, n);
+#endif
+    return decode_fast_plain(out, n);
+}
+
+
+uint64_t inflate::inflater::discard(uint64_t n) noexcept {
+/* Stored blocks and the fast loop go straight into the window. What is
+ * left, block headers and the careful decoding near the end of the
+ * input, goes through decode with a little scratch space. */
+    uint64_t discarded = 0;
+    char scratch[fast_margin];
+
+    while (discarded < n && state != finished && state != failed) {
+        uint64_t left = n - discarded;
+        if (state == stored) {
+            size_t count = std::min<uint64_t>(
+                    std::min<uint64_t>(left, stored_left), fast_window);
+            count = in.take_bytes(buf.reserve(count), count);
+            buf.commit(count);
+            discarded += count;
+            stored_left -= count;
+            if (in.truncated()) fail(inflate::error::truncated);
+            else if (stored_left == 0) end_block();
+            else within_limits();
+        }
+#if !defined(DEBUG_INFGEN_OUTPUT) && !defined(DEBUG_DUMP_CODES)
+        else if (state == codes && match_length == 0
+                && left >= fast_margin && in.can_refill()) {
+            discarded += decode_fast(nullptr,
+                    std::min<uint64_t>(left, fast_window));
+            if (state == codes) within_limits();
+        }
+#endif
+        else {
+            size_t count = decode(scratch,
+                    std::min<uint64_t>(left, sizeof(scratch)));
+            if (count == 0 && state == blockstart) break;  // lookahead
+            discarded += count;
+        }
+    }
+    return discarded;
+}
+
+
+uint64_t inflate::inflater::skip() noexcept {
+    uint64_t skipped = match_length;
+    match_length = 0;
+
+    while (true) {
+        switch (state) {
+        case finished:
+        case failed:
+            return skipped;
+
+        case blockstart:
+            next_block();
+            break;
+
+        case stored:
+            in.seekbit(in.tellbit() + uint64_t(stored_left) * 8);
+            skipped += stored_left;
+            stored_left = 0;
+            end_block();
+            break;
+
+        case codes:
+            skipped += skip_codes();
+            break;
+        }
+    }
+}
+
+uint64_t inflate::inflater::skip_codes() noexcept {
+/* decode without the output: reads every code and its extra bits up to
+ * the end of the block, adding up the lengths */
+    uint64_t skipped = 0;
+    while (state == codes) {
+        bool fast = in.can_refill();
+        if (fast) in.refill();  // enough for a whole literal or match
+
+        inflate::Symbol symbol = fast ? literals_dec->read_fast(in)
+                                      : literals_dec->read_out(in);
+        if (symbol < 0 || in.truncated()) {
+            fail(inflate::error::invalid_code);
+            break;
+        }
+        if (symbol < 256) {
+            skipped++;
+            continue;
+        }
+        if (symbol == 256) {
+            end_block();
+            break;
+        }
+        if (symbol >= 286) {
+            fail(inflate::error::invalid_literal);
+            break;
+        }
+
+        if (symbol < 265) {
+            skipped += symbol - 254;
+        }
+        else if (symbol < 285) {
+            skipped += in.take((symbol - 261) / 4)
+                + extra_length_addend[symbol - 265];
+        }
+        else {
+            skipped += 258;
+        }
+
+        int distance = fast ? distance_dec->read_fast(in)
+                            : distance_dec->read_out(in);
+        if (distance < 0) {
+            fail(inflate::error::invalid_code);
+            break;
+        }
+        if (distance >= 30) {
+            fail(inflate::error::invalid_distance);
+            break;
+        }
+        if (distance > 3) {
+            in.take((distance - 2) / 2);
+        }
+        if (in.truncated()) {
+            fail(inflate::error::truncated);
+        }
+    }
+    return skipped;
+}
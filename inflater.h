@@ -0,0 +1,115 @@
+#ifndef INFLATER_H
+#define INFLATER_H
+
+#include <cstddef>
+#include <string>
+#include "inflate.h"
+#include "decodeerror.h"
+
+namespace inflate {
+    class inflater;
+}
+
+
+// Decodes a raw deflate stream on demand. Each read decodes as much as
+// fits in the given space and suspends there, in the middle of a block
+// or of a match if need be, until the next read.
+class inflate::inflater {
+public:
+    // Decodes the blocks of a stream, up to the one with the final bit
+    inflater(ifbstream& in, ringbuffer& buf);
+    // Decodes a single block whose 3 header bits have already been read
+    inflater(ifbstream& in, ringbuffer& buf, int block_format);
+    /* Carries on from a checkpoint() of the same stream, refilling buf
+     * and seeking in to where it was. A checkpoint that does not fit
+     * leaves the inflater failed with error::bad_checkpoint. */
+    inflater(ifbstream& in, ringbuffer& buf, const std::string& checkpoint);
+
+    /* Decodes up to n bytes into out, returning the number decoded,
+     * which is only less than n at the end of the stream, where the
+     * stream is corrupt, or for want of input with set_lookahead. After
+     * the first two, failure() says what was wrong and where, and
+     * decoding goes no further. */
+    size_t decode(char* out, size_t n) noexcept;
+    inline const inflate::status& failure() const noexcept {return err;}
+    // decode, throwing what failure() would hold
+    size_t read(char* out, size_t n);
+    /* Runs to the end of the stream writing nothing, not even to the
+     * window, and returns the number of bytes decoding would have given.
+     * Without the window, distances are decoded but not checked. */
+    uint64_t skip() noexcept;
+    /* Decodes up to n bytes into the window alone, for seeking forward:
+     * the same as decode but for handing the bytes over. Returns the
+     * number decoded, short as decode is. */
+    uint64_t discard(uint64_t n) noexcept;
+    inline bool done() const noexcept {return state == finished;}
+    // the bit offset of the header of the block being decoded
+    inline uint64_t block_offset() const noexcept {return block_start;}
+    /* Everything needed to carry on decoding later, as a blob: the input
+     * bit offset, where the current block's header is, how far into the
+     * block or a match decoding is, and the window. Huffman codes are
+     * read again from the block header rather than saved. */
+    std::string checkpoint() const;
+    /* Takes the codes of dynamic blocks from cache from the next block
+     * header on, for streams repeating their headers. nullptr builds
+     * them in the inflater again. */
+    inline void use_cache(inflate::decoder_cache* cache) noexcept
+        {this->cache = cache;}
+    /* Fails decoding with error::output_limit, ratio_limit or
+     * memory_limit once past bounds, see limits. decoded_before is
+     * output of earlier streams of the same file, counted against them
+     * too; the input is counted from byte input_start of the file, its
+     * start unless the stream is one of many, as in a zip archive. */
+    void set_limits(const inflate::limits& bounds,
+            uint64_t decoded_before=0, uint64_t input_start=0) noexcept;
+    /* For input fed to in as it arrives: decode stops short at the start
+     * of a block while in has fewer than bytes buffered, to go on once
+     * more is fed. Within a block, it takes at most 2 bytes of input per
+     * byte of output and 1K of header, so bytes at least twice the
+     * output asked for plus 2K never runs out. 0 stops only at the end. */
+    inline void set_lookahead(size_t bytes) noexcept {lookahead = bytes;}
+    // the bytes held by the inflater, its window and input, and cache
+    size_t memory() const noexcept;
+
+private:
+    enum mode {blockstart, stored, codes, finished, failed};
+
+    void next_block() noexcept;
+    void begin_block(int block_format);
+    void end_block();
+    void fail(inflate::error e) noexcept;
+    inline bool within_limits() noexcept
+        {return !limited || check_limits();}
+    bool check_limits() noexcept;
+    // decode_fast_loop, compiled for each instruction set it may use
+    size_t decode_fast(char* out, size_t n) noexcept;
+    template <class Bits>
+    inline size_t decode_fast_loop(char* out, size_t n) noexcept;
+    size_t decode_fast_plain(char* out, size_t n) noexcept;
+    size_t decode_fast_bmi2(char* out, size_t n) noexcept;
+    uint64_t skip_codes() noexcept;
+
+    ifbstream& in;
+    ringbuffer& buf;
+    mode state;
+    bool last_block;
+    uint64_t block_start;
+    const inflate::Decoder* literals_dec;  // the fixed codes, or these:
+    const inflate::Decoder* distance_dec;
+    inflate::Decoder dynamic_literals, dynamic_distances;
+    inflate::decoder_cache* cache;
+    inflate::limits bounds;
+    bool limited;           // by any of bounds
+    uint64_t output_start;  // buf.written() less output before the stream
+    uint64_t input_start;   // byte the input is counted from
+    size_t lookahead;
+    int stored_left;        // bytes left in a stored block
+    int match_length;       // bytes left to copy of a suspended match
+    int match_distance;
+    inflate::status err;
+#ifdef DEBUG_INFGEN_OUTPUT
+    inflate::_UTIL::teeprint infgen_print;
+#endif
+};
+
+#endif
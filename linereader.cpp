@@ -0,0 +1,98 @@
+#include "linereader.h"
+#include "bytesearch.h"
+
+#include <cstring>
+
+namespace {
+    // igzstream decodes straight into the buffer, its own chunks are only
+    // for what is left over
+    const size_t stream_chunk_size = 4096;
+}
+
+
+inflate::linereader::linereader(std::string fn, size_t chunk_size)
+    : gz(fn, stream_chunk_size)
+    , buffer(chunk_size)
+    , begin(0)
+    , scanned(0)
+    , end(0)
+    , buffer_offset(0)
+    , line_offset(0)
+    , max_memory(0) {
+    gz.exceptions(std::ios::badbit);
+}
+
+void inflate::linereader::set_limits(const inflate::limits& bounds) {
+    gz.set_limits(bounds);
+    max_memory = bounds.max_memory;
+}
+
+bool inflate::linereader::next(std::string_view& line) {
+    while (true) {
+        const char* data = buffer.data();
+        const char* newline = inflate::find_byte(data + scanned,
+                data + end, '\n');
+        if (newline != data + end) {
+            line = std::string_view(data + begin, newline - data - begin);
+            line_offset = buffer_offset + begin;
+            begin = scanned = newline - data + 1;
+            return true;
+        }
+        scanned = end;
+
+        if (!refill()) {
+            if (begin == end) return false;
+            line = std::string_view(buffer.data() + begin, end - begin);
+            line_offset = buffer_offset + begin;
+            begin = end;
+            return true;
+        }
+    }
+}
+
+bool inflate::linereader::next_lines(std::string_view& lines) {
+    while (true) {
+        const char* data = buffer.data();
+        const char* newline = data + end;
+        while (newline > data + scanned && newline[-1] != '\n') {
+            newline--;
+        }
+        if (newline > data + scanned) {
+            lines = std::string_view(data + begin, newline - data - begin);
+            line_offset = buffer_offset + begin;
+            begin = scanned = newline - data;
+            return true;
+        }
+        scanned = end;
+
+        if (!refill()) {
+            if (begin == end) return false;
+            lines = std::string_view(buffer.data() + begin, end - begin);
+            line_offset = buffer_offset + begin;
+            begin = end;
+            return true;
+        }
+    }
+}
+
+bool inflate::linereader::refill() {
+/* Moves the unfinished line to the front and decodes after it, returning
+ * whether there was anything more */
+    std::memmove(buffer.data(), buffer.data() + begin, end - begin);
+    buffer_offset += begin;
+    scanned -= begin;
+    end -= begin;
+    begin = 0;
+    if (end == buffer.size()) {
+        // a line as long as the buffer, which may be all there is
+        if (max_memory
+                && gz.memory() + buffer.size() * 2 > max_memory) {
+            inflate::raise({inflate::error::memory_limit, 0});
+        }
+        buffer.resize(buffer.size() * 2);
+    }
+
+    gz.read(buffer.data() + end, buffer.size() - end);
+    end += gz.gcount();
+    return gz.gcount() > 0;
+}
@@ -0,0 +1,70 @@
+#ifndef LINEREADER_H
+#define LINEREADER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "igzstream.h"
+
+namespace inflate {
+    class linereader;
+
+    /* Calls f with each line of a gzip file, as a std::string_view
+     * without its '\n' that is only valid during the call. Returns the
+     * number of lines. Throws as gunzip does. */
+    template <class Function>
+    uint64_t for_each_line(std::string fn, Function f);
+}
+
+
+// Splits a gzip file into lines as it is decoded, handing each one out
+// as a view into the decode buffer rather than a copy. A line that runs
+// past the end of the buffer is moved to its front and completed there,
+// and the buffer grows for lines longer than itself.
+class inflate::linereader {
+public:
+    linereader(std::string fn, size_t chunk_size=65536);
+
+    /* The next line without its '\n', valid until the next call. The
+     * last line need not end in '\n'. False at the end of the data. */
+    bool next(std::string_view& line);
+    /* All of the whole lines there are in the buffer, at least one, as a
+     * single view ending just after a '\n' (but for the last line of the
+     * data), for searching many lines at once. */
+    bool next_lines(std::string_view& lines);
+    // where what was last returned starts in the decompressed data
+    inline uint64_t offset() const {return line_offset;}
+    /* Decoding fails past bounds, and lines too long to hold within
+     * max_memory throw decode_error with error::memory_limit */
+    void set_limits(const inflate::limits& bounds);
+
+private:
+    bool refill();
+
+    inflate::igzstream gz;
+    std::vector<char> buffer;
+    size_t begin;              // of the unread part of buffer
+    size_t scanned;            // up to which there is no '\n'
+    size_t end;
+    uint64_t buffer_offset;    // of buffer[0] in the decompressed data
+    uint64_t line_offset;
+    uint64_t max_memory;       // 0 for no limit
+};
+
+
+template <class Function>
+uint64_t inflate::for_each_line(std::string fn, Function f) {
+    inflate::linereader lines(fn);
+    std::string_view line;
+    uint64_t count = 0;
+    while (lines.next(line)) {
+        f(line);
+        count++;
+    }
+    return count;
+}
+
+#endif
@@ -0,0 +1,115 @@
+#include "matchcopy.h"
+#include "cpudispatch.h"
+
+#include <cstdint>
+#include <cstring>
+
+#ifdef INFLATE_X86_DISPATCH
+#include <immintrin.h>
+#endif
+
+
+void inflate::copy_match_scalar(char* dst, size_t distance, size_t length) {
+    const char* src = dst - distance;
+    char* end = dst + length;
+    if (distance >= 8) {
+        // every 8 byte load is of bytes already written
+        for (; dst < end; dst += 8, src += 8) {
+            uint64_t word;
+            std::memcpy(&word, src, 8);
+            std::memcpy(dst, &word, 8);
+        }
+    }
+    else {
+        while (dst < end) {
+            *dst++ = *src++;
+        }
+    }
+}
+
+#ifdef INFLATE_X86_DISPATCH
+namespace {
+    // Lays the distance bytes before dst out repeatedly from its start
+    template <int width>
+    inline void broadcast(char (&pattern)[width], const char* dst,
+            size_t distance) {
+        const char* src = dst - distance;
+        for (int i = 0; i < width; i++) {
+            pattern[i] = src[i % distance];
+        }
+    }
+}
+
+__attribute__((target("sse2")))
+void inflate::copy_match_sse2(char* dst, size_t distance, size_t length) {
+    if (length == 0) return;    // the pattern would read before dst
+    char* end = dst + length;
+    if (distance >= 16) {
+        const char* src = dst - distance;
+        for (; dst < end; dst += 16, src += 16) {
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(dst),
+                    _mm_loadu_si128(reinterpret_cast<const __m128i*>(src)));
+        }
+        return;
+    }
+    // short distances store the repeated pattern, stepping by the
+    // largest multiple of the distance that fits so the phase holds
+    char pattern[16];
+    broadcast(pattern, dst, distance);
+    __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pattern));
+    size_t step = 16 / distance * distance;
+    for (; dst < end; dst += step) {
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst), v);
+    }
+}
+
+__attribute__((target("avx2")))
+void inflate::copy_match_avx2(char* dst, size_t distance, size_t length) {
+    if (length == 0) return;    // the pattern would read before dst
+    char* end = dst + length;
+    if (distance >= 32) {
+        const char* src = dst - distance;
+        for (; dst < end; dst += 32, src += 32) {
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst),
+                    _mm256_loadu_si256(
+                        reinterpret_cast<const __m256i*>(src)));
+        }
+        return;
+    }
+    if (distance >= 16) {
+        const char* src = dst - distance;
+        for (; dst < end; dst += 16, src += 16) {
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(dst),
+                    _mm_loadu_si128(reinterpret_cast<const __m128i*>(src)));
+        }
+        return;
+    }
+    char pattern[32];
+    broadcast(pattern, dst, distance);
+    __m256i v = _mm256_loadu_si256(
+            reinterpret_cast<const __m256i*>(pattern));
+    size_t step = 32 / distance * distance;
+    for (; dst < end; dst += step) {
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst), v);
+    }
+}
+#endif
+
+
+namespace {
+    typedef void (*Kernel)(char*, size_t, size_t);
+
+    Kernel select_copy_match() {
+#ifdef INFLATE_X86_DISPATCH
+        inflate::cpu_tier tier = inflate::cpu_selected();
+        if (tier >= inflate::cpu_tier::avx2) return inflate::copy_match_avx2;
+        if (tier >= inflate::cpu_tier::sse2) return inflate::copy_match_sse2;
+#endif
+        return inflate::copy_match_scalar;
+    }
+}
+
+void inflate::copy_match(char* dst, size_t distance, size_t length) {
+    static const Kernel kernel = select_copy_match();
+    kernel(dst, distance, length);
+}
@@ -0,0 +1,28 @@
+#ifndef MATCHCOPY_H
+#define MATCHCOPY_H
+
+#include <cstddef>
+
+#include "cpudispatch.h"
+
+namespace inflate {
+    /* Bytes a match copy may write past dst + length, the destination
+     * buffer must have this much slack after its end */
+    const size_t match_slack = 32;
+
+    /* Copies length bytes starting distance bytes before dst to dst, as
+     * LZ77 does: when distance < length the copy overlaps itself and
+     * repeats the last distance bytes. A length of 0 reads nothing.
+     * Selected on the first call, by cpu_selected(), from AVX2, SSE2 and
+     * scalar implementations. */
+    void copy_match(char* dst, size_t distance, size_t length);
+
+    // The implementations, for testing and benchmarking
+    void copy_match_scalar(char* dst, size_t distance, size_t length);
+#ifdef INFLATE_X86_DISPATCH
+    void copy_match_sse2(char* dst, size_t distance, size_t length);
+    void copy_match_avx2(char* dst, size_t distance, size_t length);
+#endif
+}
+
+#endif
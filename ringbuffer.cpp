@@ -1,60 +1,132 @@
 #include "ringbuffer.h"
 
+#include <algorithm>
+#include <cstring>
 #include <iostream>
-#include <fstream>
 
-#include "teestream.h"
+#include "decodeerror.h"
+#include "matchcopy.h"
 
-std::string ringbuffer::readfrom(int length, int distance) {
-    std::stringstream out;
-    teestream tee(*this, out);
+namespace {
+    // bytes written between slides, beyond the window itself
+    const int min_block_size = 65536;
+}
 
-    this->flush();
-    int backi = (int)this->tellp() - distance;
-#ifdef DEBUG_DUMP_CODES
-    std::cout << "from " << backi << ":";
-#endif
-    // access buf as a ringbuffer
-    if (backi < 0) {
-        this->seekg(0, std::ios_base::end);
-        int buffer_size = this->tellg();
-        if (buffer_size < max_buffer_size) {
-            // buffer has not been filled
-            throw std::invalid_argument("Backpointer exceeds buffer size");
-        }
-        backi += buffer_size;
+
+ringbuffer::windowbuf::windowbuf(int size)
+    : size(size)
+    , storage(size + std::max(size, min_block_size) + inflate::match_slack)
+    , slid(0) {
+    reset();
+}
+
+void ringbuffer::windowbuf::reset() {
+    slid = 0;
+    setp(storage.data(), storage.data() + storage.size()
+            - inflate::match_slack);
+}
+
+void ringbuffer::windowbuf::slide() {
+/* Moves the last window to the front of the buffer */
+    std::ptrdiff_t held = pptr() - pbase();
+    std::ptrdiff_t keep = std::min<std::ptrdiff_t>(held, size);
+    std::memmove(pbase(), pptr() - keep, keep);
+    slid += held - keep;
+    setp(pbase(), epptr());
+    pbump(keep);
+}
+
+int ringbuffer::windowbuf::overflow(int c) {
+    slide();
+    if (c != EOF) {
+        *pptr() = (char)c;
+        pbump(1);
+    }
+    return c == EOF ? !EOF : c;
+}
+
+std::streamsize ringbuffer::windowbuf::xsputn(
+        const char* s, std::streamsize n) {
+    std::streamsize left = n;
+    while (left > 0) {
+        if (room() == 0) slide();
+        std::streamsize count = std::min(left, room());
+        std::memcpy(pptr(), s, count);
+        pbump(count);
+        s += count;
+        left -= count;
+    }
+    return n;
+}
+
+
+ringbuffer::ringbuffer(int size)
+    : std::ostream(&wbuf)
+    , wbuf(size) {
+}
+
+ringbuffer::ringbuffer(int size,
+        std::shared_ptr<const std::string> dictionary)
+    : std::ostream(&wbuf)
+    , wbuf(size)
+    , dictionary(std::move(dictionary)) {
+}
+
+const char* ringbuffer::copy(int length, int distance) {
+    char* dst = reserve(length);
+    uint64_t written = wbuf.written();
 #ifdef DEBUG_DUMP_CODES
-        std::cout << "aka " << backi << ':';
-        if(length == 7 && distance == 16928) {
-            std::cerr << this->tellp() << std::endl;
-            int temp = this->tellg();
-            std::ofstream log("buf.log");
-            this->seekg(0);
-            log << this->rdbuf();
-            this->seekg(temp);
-        }
+    std::cout << "from " << (int64_t)written - distance << ":";
 #endif
-        // reading across the link?
-        if ((buffer_size - backi) <= length) {
-            // read to the link
-            this->seekg(backi);
-            tee << this->rdbuf();
-            // continue past the link
-            length -= buffer_size - backi;
-            backi = 0;
+
+    if (!reaches(distance)) {
+        inflate::raise({inflate::error::distance_too_far, 0});
+    }
+    if ((uint64_t)distance > written) {
+        // before the start of the stream, continue into the dictionary,
+        // the window cannot have slid yet
+        int dictsize = dictionary->size();
+        int before = distance - written;
+        int count = std::min(length, before);
+        std::memcpy(dst, dictionary->data() + dictsize - before, count);
+        if (length > count) {
+            inflate::copy_match(dst + count, distance, length - count);
         }
     }
-
-    this->seekg(backi);
-    for(int i=0; i<length; i++) {
-        tee << (char)this->get();
+    else {
+        inflate::copy_match(dst, distance, length);
     }
+    wbuf.advance(length);
+    return dst;
+}
 
-    // set link if past limit
-    if (this->tellp() >= this->max_buffer_size) {
-        this->max_buffer_size = this->tellp();
-        this->seekp(0);
-    }
+char* ringbuffer::reserve(int length) {
+    if (wbuf.room() < length) wbuf.slide();
+    return wbuf.end();
+}
+
+bool ringbuffer::reaches(int distance) const noexcept {
+    uint64_t dictsize = dictionary ? dictionary->size() : 0;
+    return distance <= wbuf.size
+        && (uint64_t)distance <= wbuf.written() + dictsize;
+}
+
+std::string ringbuffer::readfrom(int length, int distance) {
+    return std::string(copy(length, distance), length);
+}
+
+void ringbuffer::reset() {
+    wbuf.reset();
+    this->clear();
+}
+
+std::string ringbuffer::str() const {
+    uint64_t held = std::min<uint64_t>(wbuf.written(), wbuf.size);
+    return std::string(wbuf.end() - held, wbuf.end());
+}
 
-    return out.str();
+void ringbuffer::resume(const std::string& window, uint64_t written) {
+    reset();
+    wbuf.sputn(window.data(), window.size());
+    wbuf.rebase(written);
 }
@@ -1,17 +1,75 @@
 #ifndef RINGBUFFER_H
 #define RINGBUFFER_H
 
-#include <sstream>
+#include <cstdint>
+#include <ostream>
+#include <streambuf>
 #include <string>
+#include <memory>
+#include <vector>
 
-class ringbuffer : public std::stringstream {
+// The sliding window of the last size bytes written, which backpointers
+// copy from. Rather than wrapping around, the buffer is a few windows
+// long and slides its last window down to the front when full, so every
+// match is a single contiguous copy and may overrun into slack space.
+class ringbuffer : public std::ostream {
 public:
-    ringbuffer(int size)
-        : max_buffer_size(size) {}
+    ringbuffer(int size);
+    // the dictionary is shared, not copied, and is read by backpointers
+    // reaching before the start of the stream
+    ringbuffer(int size, std::shared_ptr<const std::string> dictionary);
+
+    /* Appends length bytes copied from distance bytes back, returning
+     * where they are in the buffer, which is valid until the next write */
+    const char* copy(int length, int distance);
+    // whether copy can reach distance bytes back, rather than throwing
+    bool reaches(int distance) const noexcept;
     std::string readfrom(int length, int distance);
 
+    /* For decoding straight into the window: returns where the next
+     * length bytes go, with match slack after them, to be committed once
+     * written. length may be up to 65536. */
+    char* reserve(int length);
+    inline void commit(int length) {wbuf.advance(length);}
+    // bytes written since the start of the stream
+    inline uint64_t written() const {return wbuf.written();}
+    inline int size() const {return wbuf.size;}
+    // empty the buffer to start a new stream
+    void reset();
+    // the bytes in the window, oldest first
+    std::string str() const;
+    // the bytes it holds, the shared dictionary included
+    inline size_t memory() const {return sizeof(*this) + wbuf.memory()
+        + (dictionary ? dictionary->size() : 0);}
+    // refill the window from str() as it was after written bytes
+    void resume(const std::string& window, uint64_t written);
+
 private:
-    int max_buffer_size;
+    class windowbuf : public std::streambuf {
+    public:
+        windowbuf(int size);
+        void slide();
+        void reset();
+        inline uint64_t written() const
+            {return slid + (pptr() - pbase());}
+        inline char* end() const {return pptr();}
+        inline std::streamsize room() const {return epptr() - pptr();}
+        inline void advance(int count) {pbump(count);}
+        inline void rebase(uint64_t total)
+            {slid = total - (pptr() - pbase());}
+        inline size_t memory() const {return storage.size();}
+
+        const int size;
+    private:
+        virtual int overflow(int c);
+        virtual std::streamsize xsputn(const char* s, std::streamsize n);
+
+        std::vector<char> storage;
+        uint64_t slid;  // bytes dropped off the front by slides
+    };
+
+    windowbuf wbuf;
+    std::shared_ptr<const std::string> dictionary;
 };
 
 #endif
@@ -2,46 +2,100 @@
 #ifndef TEESTREAM_H
 #define TEESTREAM_H
 
+#include <algorithm>
 #include <streambuf>
 #include <ostream>
+#include <vector>
 
 class teebuf: public std::streambuf
 {
 public:
-    // Construct a streambuf which tees output to both input
-    // streambufs.
-    teebuf(std::streambuf * sb1, std::streambuf * sb2)
-        : sb1(sb1)
-        , sb2(sb2)
+    // Construct a streambuf which tees output to any number of
+    // streambufs, collecting buffer_size characters at a time.
+    teebuf(std::vector<std::streambuf*> sinks, size_t buffer_size)
+        : sinks(sinks)
+        , block(buffer_size)
     {
+        setp(block.data(), block.data() + block.size());
+    }
+
+    void attach(std::streambuf * sb)
+    {
+        forward();
+        sinks.push_back(sb);
     }
 private:
-    // This tee buffer has no buffer. So every character "overflows"
-    // and can be put directly into the teed buffers.
+    // Forward the collected block to every sink in one call each.
+    bool forward()
+    {
+        bool ok = write(pbase(), pptr() - pbase());
+        setp(block.data(), block.data() + block.size());
+        return ok;
+    }
+
+    bool write(const char * s, std::streamsize n)
+    {
+        bool ok = true;
+        if (n > 0)
+        {
+            for (auto sb : sinks)
+            {
+                ok = sb->sputn(s, n) == n && ok;
+            }
+        }
+        return ok;
+    }
+
+    // The buffer is full, or there is no buffer.
     virtual int overflow(int c)
     {
+        bool ok = forward();
         if (c == EOF)
         {
-            return !EOF;
+            return ok ? !EOF : EOF;
         }
-        else
+        if (pptr() < epptr())
         {
-            int const r1 = sb1->sputc(c);
-            int const r2 = sb2->sputc(c);
-            return r1 == EOF || r2 == EOF ? EOF : c;
+            *pptr() = (char)c;
+            pbump(1);
+            return ok ? c : EOF;
         }
+        char ch = (char)c;
+        return write(&ch, 1) && ok ? c : EOF;
     }
-    
-    // Sync both teed buffers.
+
+    // Blocks at least as large as the buffer skip it.
+    virtual std::streamsize xsputn(const char * s, std::streamsize n)
+    {
+        if (n < epptr() - pptr())
+        {
+            std::copy(s, s + n, pptr());
+            pbump(n);
+            return n;
+        }
+        bool ok = forward();
+        if (n < epptr() - pptr())
+        {
+            std::copy(s, s + n, pptr());
+            pbump(n);
+            return ok ? n : 0;
+        }
+        return write(s, n) && ok ? n : 0;
+    }
+
+    // Sync all teed buffers.
     virtual int sync()
     {
-        int const r1 = sb1->pubsync();
-        int const r2 = sb2->pubsync();
-        return r1 == 0 && r2 == 0 ? 0 : -1;
-    } 
+        bool ok = forward();
+        for (auto sb : sinks)
+        {
+            ok = sb->pubsync() == 0 && ok;
+        }
+        return ok ? 0 : -1;
+    }
 private:
-    std::streambuf * sb1;
-    std::streambuf * sb2;
+    std::vector<std::streambuf*> sinks;
+    std::vector<char> block;
 };
 
 
@@ -49,11 +103,29 @@ class teestream : public std::ostream
 {
 public:
     // Construct an ostream which tees output to the supplied
-    // ostreams.
-    teestream(std::ostream & o1, std::ostream & o2)
+    // ostreams. A buffer_size of 0 forwards every write at once.
+    teestream(std::ostream & o1, std::ostream & o2,
+            size_t buffer_size = 65536)
         : std::ostream(&tbuf)
-        , tbuf(o1.rdbuf(), o2.rdbuf()) {}
+        , tbuf({o1.rdbuf(), o2.rdbuf()}, buffer_size) {}
+
+    teestream(std::vector<std::ostream*> outs,
+            size_t buffer_size = 65536)
+        : std::ostream(&tbuf)
+        , tbuf(rdbufs(outs), buffer_size) {}
+
+    ~teestream() { flush(); }
+
+    void attach(std::ostream & o) { tbuf.attach(o.rdbuf()); }
 private:
+    static std::vector<std::streambuf*> rdbufs(
+            const std::vector<std::ostream*>& outs)
+    {
+        std::vector<std::streambuf*> sbs;
+        for (auto o : outs) sbs.push_back(o->rdbuf());
+        return sbs;
+    }
+
     teebuf tbuf;
 };
 
@@ -0,0 +1,160 @@
+#define CATCH_CONFIG_MAIN
+#include "catch.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <deque>
+#include <fstream>
+#include <iterator>
+#include <sstream>
+#include <string>
+#include <utility>
+
+#include "../chunks.h"
+
+namespace {
+    std::string contents(const char* fn) {
+        std::ifstream in(fn, std::ios::binary);
+        return std::string((std::istreambuf_iterator<char>(in)),
+                std::istreambuf_iterator<char>());
+    }
+
+    std::string gunzipped(const char* fn) {
+        std::ostringstream out;
+        inflate::gunzip(fn, out);
+        return out.str();
+    }
+
+    // coroutines waiting to go on, as an executor would run them
+    std::deque<std::coroutine_handle<>> ready;
+
+    void run() {
+        while (!ready.empty()) {
+            std::coroutine_handle<> h = ready.front();
+            ready.pop_front();
+            h.resume();
+        }
+    }
+
+    /* Hands out bytes a few at a time, each read finishing later from
+     * the queue rather than at once unless immediate */
+    struct trickle {
+        trickle(std::string bytes, size_t step)
+            : bytes(std::move(bytes)), step(step) {}
+
+        std::string bytes;
+        size_t at = 0;
+        size_t step;
+        bool immediate = false;
+        int reads = 0;
+
+        struct reading {
+            trickle& source;
+            std::span<std::byte> into;
+            bool await_ready() const noexcept {return source.immediate;}
+            void await_suspend(std::coroutine_handle<> h) {
+                ready.push_back(h);
+            }
+            size_t await_resume() {
+                source.reads++;
+                size_t n = std::min({into.size(), source.step,
+                        source.bytes.size() - source.at});
+                std::memcpy(into.data(), source.bytes.data() + source.at, n);
+                source.at += n;
+                source.step = source.step * 7 % 9973 + 1;
+                return n;
+            }
+        };
+        reading read(std::span<std::byte> into) {return {*this, into};}
+    };
+
+    // a consumer coroutine, running until its first suspension
+    struct task {
+        struct promise_type {
+            task get_return_object() noexcept {return {};}
+            std::suspend_never initial_suspend() noexcept {return {};}
+            std::suspend_never final_suspend() noexcept {return {};}
+            void return_void() noexcept {}
+            void unhandled_exception() {throw;}
+        };
+    };
+
+    task collect(trickle& source, std::string& out, std::string& error,
+            bool& done) {
+        try {
+            auto data = inflate::chunks(source, 4096);
+            while (auto chunk = co_await data.next()) {
+                out.append(reinterpret_cast<const char*>(chunk->data()),
+                        chunk->size());
+            }
+        }
+        catch (const std::exception& e) {
+            error = e.what();
+        }
+        done = true;
+    }
+}
+
+TEST_CASE("chunks of a file", "[chunks]") {
+    std::string expected = gunzipped("teestream.h.gch.gz");
+    std::string decoded;
+    size_t largest = 0;
+    for (std::span<const std::byte> chunk :
+            inflate::chunks("teestream.h.gch.gz", 10000)) {
+        decoded.append(reinterpret_cast<const char*>(chunk.data()),
+                chunk.size());
+        largest = std::max(largest, chunk.size());
+    }
+    CHECK(decoded.size() == 17367504);
+    CHECK(decoded == expected);
+    CHECK(largest == 10000);
+
+    // stopping early leaves the rest undecoded
+    for (std::span<const std::byte> chunk :
+            inflate::chunks("teestream.h.gch.gz")) {
+        CHECK(chunk.size() == 65536);
+        break;
+    }
+    CHECK_THROWS_AS(inflate::chunks("no_such_file.gz").begin(),
+            const std::ios_base::failure&);
+}
+
+TEST_CASE("chunks from an awaited source", "[chunks]") {
+    std::string expected = gunzipped("teestream.h.gch.gz");
+    trickle source(contents("teestream.h.gch.gz"), 1);
+    std::string decoded, error;
+    bool done = false;
+    collect(source, decoded, error, done);
+    CHECK_FALSE(done);  // waiting on the first read
+    run();
+    REQUIRE(done);
+    CHECK(error.empty());
+    CHECK(decoded == expected);
+    CHECK(source.reads > 100);
+
+    SECTION("members in reads from a byte up") {
+        std::string member = contents("inflate_test_copy.cpp.gz");
+        trickle bytewise(member + member, 1);
+        bytewise.immediate = true;
+        decoded.clear();
+        done = false;
+        collect(bytewise, decoded, error, done);
+        run();
+        REQUIRE(done);
+        CHECK(error.empty());
+        std::string one = gunzipped("inflate_test_copy.cpp.gz");
+        CHECK(decoded == one + one);
+    }
+
+    SECTION("truncated") {
+        trickle cut(source.bytes.substr(0, 1000000), 5000);
+        decoded.clear();
+        done = false;
+        collect(cut, decoded, error, done);
+        run();
+        REQUIRE(done);
+        CHECK(error.find("Error reading compressed block") == 0);
+        CHECK(decoded.size() > 0);
+        CHECK(decoded == expected.substr(0, decoded.size()));
+    }
+}
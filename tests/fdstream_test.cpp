@@ -0,0 +1,109 @@
+#define CATCH_CONFIG_MAIN
+#include "catch.hpp"
+
+#include <cstdio>
+#include <fcntl.h>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <thread>
+#include <unistd.h>
+
+#include "../fdstream.h"
+
+namespace {
+    // bytes no two blocks of which are alike, in writes of uneven sizes
+    std::string pattern(size_t size) {
+        std::string bytes(size, 0);
+        for (size_t i = 0; i < size; i++) {
+            bytes[i] = (char)(i * 7 + i / 4093);
+        }
+        return bytes;
+    }
+
+    void write_in_parts(std::ostream& out, const std::string& bytes) {
+        size_t at = 0;
+        for (size_t part = 1; at < bytes.size(); part = part * 3 + 1) {
+            part = std::min(part % 300000, bytes.size() - at);
+            out.write(bytes.data() + at, part);
+            at += part;
+            if (part % 5 == 0) out.flush();
+        }
+        out << 'x';
+    }
+}
+
+TEST_CASE("splicing into a pipe", "[fdstream]") {
+    int fds[2];
+    REQUIRE( pipe(fds) == 0 );
+    std::string expected = pattern(5000000);
+    std::string read;
+    std::thread reader([&] {
+        char block[10000];
+        ssize_t got;
+        while ((got = ::read(fds[0], block, sizeof(block))) > 0) {
+            read.append(block, got);
+            // slowly, so the blocks wait in the pipe
+            if (read.size() % 7 == 0) usleep(100);
+        }
+    });
+    {
+        fdstream out(fds[1], 65536);
+        CHECK( out.splicing() );
+        write_in_parts(out, expected);
+    }
+    close(fds[1]);
+    reader.join();
+    close(fds[0]);
+    CHECK( read.size() == expected.size() + 1 );
+    CHECK( read == expected + 'x' );
+}
+
+TEST_CASE("splicing on to another pipe", "[fdstream]") {
+    // the reader moves the pages on without reading them, and reads them
+    // only once everything is written, as tee and pv may
+    int first[2], second[2];
+    REQUIRE( pipe(first) == 0 );
+    REQUIRE( pipe(second) == 0 );
+    REQUIRE( fcntl(second[1], F_SETPIPE_SZ, 1 << 20) >= (1 << 20) );
+    std::string expected = pattern(700000);
+    std::thread mover([&] {
+        while (splice(first[0], nullptr, second[1], nullptr, 1 << 20, 0)
+                > 0) {}
+        close(second[1]);
+    });
+    {
+        fdstream out(first[1], 65536);
+        CHECK( out.splicing() );
+        write_in_parts(out, expected);
+    }
+    close(first[1]);
+    mover.join();
+    close(first[0]);
+    std::string read;
+    char block[10000];
+    ssize_t got;
+    while ((got = ::read(second[0], block, sizeof(block))) > 0) {
+        read.append(block, got);
+    }
+    close(second[0]);
+    CHECK( read == expected + 'x' );
+}
+
+TEST_CASE("writing to a file", "[fdstream]") {
+    std::string expected = pattern(3000000);
+    int fd = open("fdstream_test.out", O_WRONLY|O_CREAT|O_TRUNC, 0644);
+    REQUIRE( fd >= 0 );
+    {
+        fdstream out(fd, 100000);
+        CHECK_FALSE( out.splicing() );
+        write_in_parts(out, expected);
+        CHECK( out.good() );
+    }
+    close(fd);
+    std::ifstream in("fdstream_test.out", std::ios::binary);
+    std::string read((std::istreambuf_iterator<char>(in)),
+            std::istreambuf_iterator<char>());
+    CHECK( read == expected + 'x' );
+    std::remove("fdstream_test.out");
+}
@@ -1,7 +1,16 @@
 #define CATCH_CONFIG_MAIN
 #include "catch.hpp"
 
-#include "../ifbstream.cpp"
+#include <cerrno>
+#include <fcntl.h>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <unistd.h>
+
+#include "../ifbstream.h"
+#include "../decodeerror.h"
+#include "../asyncreader.h"
 
 TEST_CASE("Reading bits from a file", "[ifbstream]") {
     ifbstream A("ifbstream.txt");
@@ -9,3 +18,92 @@ TEST_CASE("Reading bits from a file", "[ifbstream]") {
     REQUIRE( A.next() == 1 );
     REQUIRE( A.read(15) == (2 << 7) );
 }
+
+TEST_CASE("Mixing bits and bytes", "[ifbstream]") {
+    ifbstream A("ifbstream.txt");
+
+    REQUIRE( A.read(3) == 1 );
+    REQUIRE( A.tellg() == 1 );
+    char bytes[2];
+    A.read_bytes(bytes, 2);     // skips the rest of the first byte
+    REQUIRE( bytes[0] == 2 );
+    REQUIRE( bytes[1] == 3 );
+    REQUIRE( A.tellg() == 3 );
+    REQUIRE( A.read(16) == 0x0a04 );
+    REQUIRE_FALSE( A.can_refill() );
+    REQUIRE_THROWS( A.next() );
+
+    A.seekg(1);
+    REQUIRE( A.read(8) == 2 );
+}
+
+TEST_CASE("Reading ahead", "[ifbstream][asyncreader]") {
+    std::ifstream file("teestream.h.gch.gz", std::ios::binary);
+    std::string bytes((std::istreambuf_iterator<char>(file)),
+            std::istreambuf_iterator<char>());
+    REQUIRE( bytes.size() > 3 * 4096 );
+
+    int fd = open("teestream.h.gch.gz", O_RDONLY);
+    REQUIRE( fd >= 0 );
+    for (bool use_io_uring : {true, false}) {
+        asyncreader ahead(fd, 2, 4096, use_io_uring);
+        std::string read;
+        const char* data;
+        size_t size;
+        while ((size = ahead.next(data)) > 0) {
+            read.append(data, size);
+        }
+        CHECK( read == bytes );
+        CHECK( ahead.next(data) == 0 );
+        CHECK_FALSE( ahead.failed() );
+
+        ahead.seek(5000);
+        REQUIRE( ahead.next(data) == 4096 );
+        CHECK( std::string(data, 4096) == bytes.substr(5000, 4096) );
+    }
+    close(fd);
+}
+
+TEST_CASE("Bits from blocks read ahead", "[ifbstream][asyncreader]") {
+    ifbstream A("teestream.h.gch.gz");
+    ifbstream B("teestream.h.gch.gz", 3, 4096);
+    REQUIRE( B.is_open() );
+
+    for (int i = 0; i < 1000; i++) {
+        REQUIRE( A.read(13) == B.read(13) );
+    }
+    std::vector<char> a(9000), b(9000);
+    REQUIRE( A.take_bytes(a.data(), 9000) == 9000 );
+    REQUIRE( B.take_bytes(b.data(), 9000) == 9000 );
+    CHECK( a == b );
+
+    A.seekg(4000);
+    B.seekg(4000);
+    CHECK( A.read(32) == B.read(32) );
+    CHECK( A.tellg() == B.tellg() );
+
+    while (!B.at_end()) B.read(8);
+    CHECK_THROWS( B.next() );
+    CHECK_FALSE( ifbstream("no_such_file", 3).is_open() );
+}
+
+TEST_CASE("Reads ahead that fail", "[ifbstream][asyncreader]") {
+    int fd = open(".", O_RDONLY|O_DIRECTORY);  // reads fail with EISDIR
+    REQUIRE( fd >= 0 );
+    for (bool use_io_uring : {true, false}) {
+        asyncreader ahead(fd, 2, 4096, use_io_uring);
+        const char* data;
+        CHECK( ahead.next(data) == 0 );
+        CHECK( ahead.failed() );
+        CHECK( ahead.error() == EISDIR );
+    }
+    close(fd);
+
+    ifbstream A(".", 2);
+    REQUIRE( A.is_open() );
+    CHECK( A.take(8) == 0 );
+    CHECK( A.truncated() );
+    CHECK( A.error() == EISDIR );
+    CHECK( A.shortfall() == inflate::error::read_failed );
+    CHECK_THROWS_AS( A.next(), const std::ios_base::failure& );
+}
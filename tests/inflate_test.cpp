@@ -1,106 +1,55 @@
 #define CATCH_CONFIG_MAIN
 #include "catch.hpp"
 
-//#define DEBUG_INFGEN_OUTPUT
-//#define DEBUG_INFGEN_OUTPUT_D
-//#define DEBUG_DUMP_CODES
-#include "../inflate.cpp"
-#include "../ifbstream.cpp"
-#include "../ringbuffer.cpp"
-#include "../huffmantree.cpp"
-
-TEST_CASE("range operations", "[rangeops][utils][all]") {
-    
-    SECTION("basic range operations") {
-        std::vector<inflate::Range> ranges1 = {
-            (inflate::Range){1, 4},
-            (inflate::Range){4, 6},
-            (inflate::Range){6, 4},
-            (inflate::Range){14, 5},
-            (inflate::Range){18, 6},
-            (inflate::Range){21, 4},
-            (inflate::Range){26, 6}
-        };
-        std::vector<inflate::Range> ranges2 = {
-            (inflate::Range){0, 8},
-            (inflate::Range){4, 10},
-            (inflate::Range){5, 8},
-            (inflate::Range){7, 7},
-            (inflate::Range){8, 5},
-            (inflate::Range){13, 5},
-            (inflate::Range){16, 4},
-            (inflate::Range){17, 5},
-            (inflate::Range){21, 4},
-            (inflate::Range){22, 3},
-            (inflate::Range){24, 4},
-            (inflate::Range){26, 5},
-            (inflate::Range){27, 8}
-        };
-        
-        SECTION("counting") {
-            std::vector<int> temp1 = {0, 0, 0, 0, 7, 8, 12};
-            REQUIRE(inflate::_UTIL::count_by_bitlength(ranges1) == temp1);
+#include "../inflate.h"
+#include "../ifbstream.h"
+#include "../ringbuffer.h"
+#include "../matchcopy.h"
+#include "../huffmantree.h"
+#include "../decodercache.h"
+#include "../adler32.h"
+#include "../crc32.h"
+#include "../cpudispatch.h"
+#include "../decodeerror.h"
+#include "../inflater.h"
+#include "../igzstream.h"
+#include "../bytesearch.h"
+#include "../linereader.h"
+#include "../grep.h"
 
-            std::vector<int> temp2 = {0, 0, 0, 1, 9, 9, 0, 2, 3, 0, 4};
-            REQUIRE(inflate::_UTIL::count_by_bitlength(ranges2) == temp2);
-        }
+#include <unistd.h>
 
-        SECTION("grouping") {
-            std::vector<unsigned int> lengths = {
-                4,4,            // 1
-                6,6,6,          // 4
-                4,4,            // 6
-                5,5,5,5,5,5,5,5,// 14
-                6,6,6,6,        // 18
-                4,4,4,          // 21
-                6,6,6,6,6};     // 26
-            auto tranges1 = inflate::_UTIL::group_into_ranges(
-                    lengths.begin(), lengths.end());
-            REQUIRE(tranges1.size() == ranges1.size());
-            REQUIRE(std::equal(tranges1.begin(), tranges1.end(), 
-                        ranges1.begin(),
-                        [](inflate::Range x, inflate::Range y) {
-                            return x.end == y.end 
-                            && x.bit_length == y.bit_length;
-                            })
-                   );
-        }
+namespace {
+    // the bytes of inflate_test_copy.cpp.gz, count times over, as members
+    std::string members(int count) {
+        std::ifstream in("inflate_test_copy.cpp.gz", std::ios::binary);
+        std::string bytes((std::istreambuf_iterator<char>(in)),
+                std::istreambuf_iterator<char>());
+        std::string all;
+        for (int i = 0; i < count; i++) all += bytes;
+        return all;
     }
-    
-    SECTION("more ranges operations") {
-        SECTION("1") {
-        std::vector<unsigned int> lengths = {4, 0, 0, 6, 5, 3, 3, 3, 4, 4, 3, 3, 4, 0, 0, 0, 6, 5, 5};
-        auto tranges = inflate::_UTIL::group_into_ranges(
-                lengths.begin(), lengths.end());
-
-        std::vector<inflate::Range> ranges = {
-            (inflate::Range){0, 4},
-            (inflate::Range){2, 0},
-            (inflate::Range){3, 6},
-            (inflate::Range){4, 5},
-            (inflate::Range){7, 3},
-            (inflate::Range){9, 4},
-            (inflate::Range){11, 3},
-            (inflate::Range){12, 4},
-            (inflate::Range){15, 0},
-            (inflate::Range){16, 6},
-            (inflate::Range){18, 5},
-        };
-        std::ostringstream out;
-        for(auto& range : tranges) {
-            out << range.end << ':' << range.bit_length << ", ";
-        }
-        INFO("tranges = [" << out.str() << ']');
-        REQUIRE(tranges.size() == ranges.size());
-        REQUIRE(std::equal(tranges.begin(), tranges.end(),
-                    ranges.begin(),
-                    [](inflate::Range x, inflate::Range y) {
-                        return x.end == y.end 
-                        && x.bit_length == y.bit_length;
-                        })
-            );
+
+    // a file in /tmp holding contents, removed again however a test ends
+    class temp_file {
+    public:
+        explicit temp_file(const std::string& contents) {
+            char name[] = "/tmp/inflate_testXXXXXX";
+            int fd = mkstemp(name);
+            REQUIRE(fd >= 0);
+            ::close(fd);
+            fn = name;
+            std::ofstream(fn, std::ios::binary) << contents;
         }
-    }
+        ~temp_file() {std::remove(fn.c_str());}
+        temp_file(const temp_file&) = delete;
+        temp_file& operator=(const temp_file&) = delete;
+
+        inline const char* name() const {return fn.c_str();}
+
+    private:
+        std::string fn;
+    };
 }
 
 TEST_CASE("build_tree", "[build_tree][utils][all]") {
@@ -140,42 +89,692 @@ TEST_CASE("build_tree", "[build_tree][utils][all]") {
 
 }
 
-TEST_CASE("Test header decoding", "[headers][all]") {
-    ifbstream testdata("gunzip.c.gz.body");
+TEST_CASE("small", "[fullfiles][all]") {
+    CHECK_NOTHROW(inflate::gunzip("inflate_test_copy.cpp.gz"));
+}
+
+TEST_CASE("bufferoverflow", "[fullfiles][all]") {
+    CHECK_NOTHROW(inflate::gunzip("teestream.h.gch.gz"));
+}
+
 
-    SECTION("preheaders") {
-        testdata.read(13);
+TEST_CASE("adler32", "[checksums][all]") {
+    std::string wiki = "Wikipedia";
+    REQUIRE(inflate::adler32(1, wiki.data(), wiki.size()) == 0x11E60398);
 
-        auto ranges2 = inflate::_UTIL::read_preheader(testdata);
-        std::vector<std::vector<int>> temp3 = {{0,3}, {3,0}, {5,4}, {6,3}, {7,2}, {9,3}, {10,4}, {11,5}, {15,0}, {16,6}, {18,7}};
-        REQUIRE(std::equal(ranges2.begin(), ranges2.end(), temp3.begin(),
-                    [](inflate::Range x, std::vector<int> y) {
-                        return x.end == y[0] && x.bit_length == y[1];
-                    })
-               );
+    // long enough to take the vectorized path and the modulo reductions
+    std::string ones(100000, '\xff');
+    uint32_t whole = inflate::adler32(1, ones.data(), ones.size());
+    uint32_t pieces = inflate::adler32(1, ones.data(), 12345);
+    pieces = inflate::adler32(pieces, ones.data() + 12345, 100000 - 12345);
+    REQUIRE(whole == pieces);
+    uint32_t s1 = 1, s2 = 0;
+    for (char c : ones) {
+        s1 = (s1 + (unsigned char)c) % 65521;
+        s2 = (s2 + s1) % 65521;
     }
+    REQUIRE(whole == ((s2 << 16) | s1));
+}
 
-    SECTION("full headers") {
-        testdata.read(3);
-        
-        auto trees = inflate::read_deflate_header(testdata);
-        std::string temp4 = "-1 -1 -1 -1 -1 -1 -1 -1 -1 -1 -1 256 # # 92 # # -1 90 # # 80 # # -1 279 # # 277 # # -1 -1 276 # # 124 # # -1 123 # # 122 # # -1 -1 -1 88 # # 76 # # -1 72 # # 66 # # -1 -1 63 # # 35 # # 120 # # -1 -1 -1 107 # # 93 # # -1 91 # # 85 # # -1 -1 84 # # 83 # # -1 82 # # 79 # # -1 -1 -1 -1 78 # # 77 # # -1 73 # # 70 # # -1 -1 68 # # 67 # # -1 65 # # 58 # # -1 -1 -1 47 # # 39 # # -1 37 # # 33 # # -1 275 # # 274 # # -1 -1 -1 -1 273 # # 125 # # -1 121 # # 119 # # -1 -1 118 # # 106 # # -1 103 # # 69 # # -1 -1 -1 62 # # 60 # # -1 57 # # 55 # # -1 -1 52 # # 43 # # -1 42 # # 41 # # -1 -1 -1 -1 -1 38 # # 34 # # 272 # # -1 271 # # 270 # # -1 -1 117 # # 112 # # -1 109 # # 104 # # -1 -1 -1 102 # # 98 # # -1 95 # # 61 # # -1 -1 59 # # 56 # # -1 54 # # 53 # # -1 -1 -1 -1 -1 51 # # 50 # # -1 48 # # 46 # # -1 -1 45 # # 44 # # -1 40 # # 10 # # -1 -1 269 # # 268 # # -1 264 # # 116 # # -1 -1 -1 115 # # 114 # # -1 111 # # 110 # # -1 -1 108 # # 105 # # -1 100 # # 99 # # -1 -1 -1 -1 -1 97 # # 49 # # 267 # # -1 266 # # 265 # # -1 -1 263 # # 262 # # -1 261 # # 260 # # -1 -1 -1 101 # # 32 # # 259 # # -1 258 # # 257 # # "; 
-        std::string temp5 = "-1 -1 -1 -1 -1 -1 -1 -1 -1 4 # # 3 # # -1 2 # # 1 # # -1 5 # # 0 # # -1 7 # # 6 # # -1 27 # # 9 # # -1 26 # # 25 # # -1 -1 17 # # 15 # # -1 13 # # 8 # # -1 -1 24 # # 23 # # -1 22 # # 21 # # -1 -1 -1 20 # # 19 # # -1 18 # # 16 # # -1 -1 14 # # 12 # # -1 11 # # 10 # # ";
-        REQUIRE(trees.first.str() == temp4);
-        REQUIRE(trees.second.str() == temp5);
+TEST_CASE("checksum kernels", "[checksums][all]") {
+    typedef uint32_t (*Checksum)(uint32_t, const char*, size_t);
+    std::vector<Checksum> crcs = {inflate::crc32_scalar};
+    std::vector<Checksum> adlers = {inflate::adler32_scalar};
+#ifdef INFLATE_X86_DISPATCH
+    inflate::cpu_tier tier = inflate::cpu_detected();
+    if (tier >= inflate::cpu_tier::sse2) {
+        adlers.push_back(inflate::adler32_sse2);
+    }
+    if (tier >= inflate::cpu_tier::sse42) {
+        crcs.push_back(inflate::crc32_pclmul);
+    }
+    if (tier >= inflate::cpu_tier::avx2) {
+        adlers.push_back(inflate::adler32_avx2);
     }
+#endif
+    REQUIRE(inflate::crc32(0, "123456789", 9) == 0xcbf43926);
 
-    SECTION("gunzipping blocks") {
-        testdata.read(3);
-        CHECK_NOTHROW(inflate::inflate_block(testdata));
+    // every length around the vector widths and folds, at every alignment
+    std::string data(20000, '\0');
+    uint32_t x = 1;
+    for (char& c : data) {
+        x = x * 1103515245 + 12345;
+        c = x >> 24;
+    }
+    for (size_t len = 0; len < 300; len++) {
+        for (size_t offset = 0; offset < 16; offset += 5) {
+            const char* p = data.data() + offset;
+            uint32_t crc = inflate::crc32_scalar(123, p, len);
+            uint32_t adler = inflate::adler32_scalar(1, p, len);
+            for (Checksum kernel : crcs) {
+                REQUIRE(kernel(123, p, len) == crc);
+            }
+            for (Checksum kernel : adlers) {
+                REQUIRE(kernel(1, p, len) == adler);
+            }
+        }
+    }
+    std::string ones(20000, '\xff');
+    for (Checksum kernel : adlers) {
+        CHECK(kernel(1, data.data(), data.size())
+                == inflate::adler32_scalar(1, data.data(), data.size()));
+        CHECK(kernel(1, ones.data(), ones.size())
+                == inflate::adler32_scalar(1, ones.data(), ones.size()));
+    }
+    for (Checksum kernel : crcs) {
+        CHECK(kernel(0, data.data(), data.size())
+                == inflate::crc32_scalar(0, data.data(), data.size()));
     }
 }
 
-TEST_CASE("small", "[fullfiles][all]") {
-    CHECK_NOTHROW(inflate::gunzip("inflate_test_copy.cpp.gz"));
+TEST_CASE("containers", "[fullfiles][all]") {
+    std::ostringstream gz, zz, raw, stored;
+    inflate::gunzip("inflate_test_copy.cpp.gz", gz);
+    REQUIRE(gz.str().size() == 7890);
+
+    inflate::uncompress("inflate_test_copy.cpp.zz", zz);
+    REQUIRE(zz.str() == gz.str());
+
+    inflate::inflate_raw("inflate_test_copy.cpp.deflate", raw);
+    REQUIRE(raw.str() == gz.str());
+
+    inflate::uncompress("inflate_test_stored.zz", stored);
+    REQUIRE(stored.str() == gz.str());
+
+    CHECK_THROWS(inflate::uncompress("inflate_test_copy.cpp.gz", zz));
 }
 
-TEST_CASE("bufferoverflow", "[fullfiles][all]") {
-    CHECK_NOTHROW(inflate::gunzip("teestream.h.gch.gz"));
+TEST_CASE("preset dictionaries", "[dictionary][fullfiles][all]") {
+    std::ostringstream expected, zz, raw;
+    inflate::gunzip("inflate_test_copy.cpp.gz", expected);
+
+    std::ifstream dictfile("inflate_test.dict", std::ios::binary);
+    std::ostringstream bytes;
+    bytes << dictfile.rdbuf();
+    inflate::dictionary dict(bytes.str());
+
+    inflate::uncompress("inflate_test_dict.zz", zz, dict);
+    REQUIRE(zz.str() == expected.str());
+
+    inflate::inflate_raw("inflate_test_dict.deflate", raw, dict);
+    REQUIRE(raw.str() == expected.str());
+
+    // the header names a dictionary, so one must be given and match
+    CHECK_THROWS(inflate::uncompress("inflate_test_dict.zz", zz));
+    CHECK_THROWS(inflate::uncompress("inflate_test_dict.zz", zz,
+                inflate::dictionary("not the dictionary")));
+}
+
+TEST_CASE("pulling from igzstream", "[igzstream][fullfiles][all]") {
+    std::ostringstream expected;
+    inflate::gunzip("inflate_test_copy.cpp.gz", expected);
+
+    SECTION("by line") {
+        inflate::igzstream gz("inflate_test_copy.cpp.gz");
+        std::istringstream lines(expected.str());
+        std::string line, expected_line;
+        int count = 0;
+        while (std::getline(gz, line)) {
+            REQUIRE(std::getline(lines, expected_line));
+            REQUIRE(line == expected_line);
+            count++;
+        }
+        REQUIRE(count > 100);
+        REQUIRE(!std::getline(lines, expected_line));
+    }
+
+    SECTION("in chunks smaller than a match") {
+        // suspends decoding in the middle of matches
+        inflate::igzstream gz("inflate_test_copy.cpp.gz", 7);
+        std::string contents;
+        char c;
+        while (gz.get(c)) contents += c;
+        REQUIRE(contents == expected.str());
+    }
+
+    SECTION("in bulk") {
+        inflate::igzstream gz("inflate_test_copy.cpp.gz", 16);
+        std::string contents(10000, '\0');
+        gz.read(&contents[0], 10000);
+        REQUIRE(gz.gcount() == 7890);
+        contents.resize(gz.gcount());
+        REQUIRE(contents == expected.str());
+    }
+
+    SECTION("seeking forward") {
+        inflate::igzstream gz("inflate_test_copy.cpp.gz", 16);
+        std::string contents(100, '\0');
+        gz.read(&contents[0], 10);
+        gz.seekg(5, std::ios::cur);
+        REQUIRE(gz.tellg() == 15);
+        gz.read(&contents[0], 100);
+        REQUIRE(contents == expected.str().substr(15, 100));
+
+        gz.seekg(7000);
+        REQUIRE(gz.tellg() == 7000);
+        std::string rest((std::istreambuf_iterator<char>(gz)),
+                std::istreambuf_iterator<char>());
+        REQUIRE(rest == expected.str().substr(7000));
+
+        gz.clear();
+        gz.seekg(100);  // backwards
+        REQUIRE(gz.fail());
+    }
+}
+
+TEST_CASE("igzstream over members", "[igzstream][checkpoint][fullfiles][all]") {
+    temp_file twice(members(2));
+    const char* fn = twice.name();
+    std::ostringstream copy;
+    inflate::gunzip("inflate_test_copy.cpp.gz", copy);
+    std::string expected = copy.str() + copy.str();
+
+    std::ostringstream gunzipped;
+    inflate::gunzip(fn, gunzipped);
+    CHECK(gunzipped.str() == expected);
+
+    SECTION("byte by byte and in bulk") {
+        inflate::igzstream gz(fn, 7);
+        std::string contents;
+        char c;
+        while (gz.get(c)) contents += c;
+        CHECK(contents == expected);
+        CHECK(!gz.bad());
+
+        inflate::igzstream bulk(fn, 16);
+        contents.assign(20000, '\0');
+        bulk.read(&contents[0], contents.size());
+        CHECK(bulk.gcount() == (std::streamsize)expected.size());
+        contents.resize(bulk.gcount());
+        CHECK(contents == expected);
+    }
+
+    SECTION("seeking into the second member") {
+        inflate::igzstream gz(fn, 16);
+        gz.seekg(7890 + 100);
+        REQUIRE(gz.tellg() == 7890 + 100);
+        std::string rest((std::istreambuf_iterator<char>(gz)),
+                std::istreambuf_iterator<char>());
+        CHECK(rest == expected.substr(7890 + 100));
+        CHECK(!gz.bad());
+    }
+
+    SECTION("checkpoints in either member") {
+        for (size_t stop = 0; stop <= expected.size(); stop += 1579) {
+            inflate::igzstream gz(fn, 7);
+            std::string head(stop, '\0');
+            gz.read(&head[0], stop);
+            std::string blob = gz.checkpoint();
+
+            inflate::igzstream resumed(fn, blob, 7);
+            std::string rest((std::istreambuf_iterator<char>(resumed)),
+                    std::istreambuf_iterator<char>());
+            REQUIRE(head + rest == expected);
+            REQUIRE(!resumed.bad());
+        }
+    }
+
+    SECTION("limits over the whole file") {
+        inflate::igzstream gz(fn);
+        gz.set_limits({10000, 0, 0});
+        std::string contents(expected.size(), '\0');
+        gz.read(&contents[0], contents.size());
+        CHECK(gz.bad());
+        CHECK(gz.gcount() < (std::streamsize)expected.size());
+    }
+}
+
+TEST_CASE("reading lines", "[lines][fullfiles][all]") {
+    SECTION("byte search kernels") {
+        std::string text(300, 'a');
+        std::vector<const char* (*)(const char*, const char*, char)> kernels
+            = {inflate::find_byte_scalar};
+#ifdef INFLATE_X86_DISPATCH
+        if (inflate::cpu_detected() >= inflate::cpu_tier::sse2) {
+            kernels.push_back(inflate::find_byte_sse2);
+        }
+        if (inflate::cpu_detected() >= inflate::cpu_tier::avx2) {
+            kernels.push_back(inflate::find_byte_avx2);
+        }
+#endif
+        for (auto find : kernels) {
+            for (size_t at = 0; at < 100; at++) {
+                text[at] = '\n';
+                for (size_t from = 0; from <= at; from += 7) {
+                    REQUIRE(find(&text[from], &text[200], '\n')
+                            == &text[at]);
+                }
+                REQUIRE(find(&text[at + 1], &text[200], '\n')
+                        == &text[200]);
+                text[at] = 'a';
+            }
+            REQUIRE(find(&text[0], &text[0], 'a') == &text[0]);
+        }
+    }
+
+    std::ostringstream expected;
+    inflate::gunzip("inflate_test_copy.cpp.gz", expected);
+    std::istringstream expected_lines(expected.str());
+    std::vector<std::string> lines;
+    std::string line;
+    while (std::getline(expected_lines, line)) lines.push_back(line);
+
+    SECTION("for_each_line") {
+        size_t i = 0;
+        uint64_t count = inflate::for_each_line("inflate_test_copy.cpp.gz",
+                [&](std::string_view line) {
+                    REQUIRE(i < lines.size());
+                    REQUIRE(line == lines[i++]);
+                });
+        REQUIRE(count == lines.size());
+    }
+
+    SECTION("lines longer than the buffer") {
+        inflate::linereader reader("inflate_test_copy.cpp.gz", 16);
+        std::string_view view;
+        uint64_t offset = 0;
+        for (auto& line : lines) {
+            REQUIRE(reader.next(view));
+            REQUIRE(view == line);
+            REQUIRE(reader.offset() == offset);
+            offset += line.size() + 1;
+        }
+        REQUIRE(!reader.next(view));
+    }
+
+    SECTION("lines of every member") {
+        temp_file twice(members(2));
+        std::vector<std::string> both = lines;
+        both.insert(both.end(), lines.begin(), lines.end());
+
+        size_t i = 0;
+        uint64_t count = inflate::for_each_line(twice.name(),
+                [&](std::string_view line) {
+                    REQUIRE(i < both.size());
+                    REQUIRE(line == both[i++]);
+                });
+        CHECK(count == both.size());
+    }
+}
+
+TEST_CASE("grep", "[grep][fullfiles][all]") {
+    SECTION("string search kernels") {
+        std::string text(300, '.');
+        std::vector<const char* (*)(const char*, const char*, const char*,
+                size_t)> kernels = {inflate::find_string_scalar};
+#ifdef INFLATE_X86_DISPATCH
+        if (inflate::cpu_detected() >= inflate::cpu_tier::sse2) {
+            kernels.push_back(inflate::find_string_sse2);
+        }
+        if (inflate::cpu_detected() >= inflate::cpu_tier::avx2) {
+            kernels.push_back(inflate::find_string_avx2);
+        }
+#endif
+        std::string pattern = "abcdefghijklmnopqrstuvwxyz0123456789";
+        for (auto find : kernels) {
+            for (size_t length = 1; length < pattern.size(); length += 5) {
+                for (size_t at = 0; at + length <= 200; at += 3) {
+                    text.replace(at, length, pattern, 0, length);
+                    REQUIRE(find(&text[0], &text[200], pattern.data(),
+                                length) == &text[at]);
+                    // cut short by one, or started after it
+                    REQUIRE(find(&text[0], &text[at + length - 1],
+                                pattern.data(), length)
+                            == &text[at + length - 1]);
+                    REQUIRE(find(&text[at + 1], &text[200], pattern.data(),
+                                length) == &text[200]);
+                    text.replace(at, length, length, '.');
+                }
+            }
+            REQUIRE(find(&text[0], &text[200], "", 0) == &text[0]);
+        }
+    }
+
+    std::ostringstream expected;
+    inflate::gunzip("inflate_test_copy.cpp.gz", expected);
+    std::istringstream expected_lines(expected.str());
+    std::vector<std::pair<uint64_t, std::string>> want;
+    std::string line;
+    uint64_t offset = 0;
+    while (std::getline(expected_lines, line)) {
+        if (line.find("CHECK") != std::string::npos
+                || line.find("gunzip") != std::string::npos) {
+            want.push_back({offset, line});
+        }
+        offset += line.size() + 1;
+    }
+    REQUIRE(want.size() > 2);
+
+    std::vector<std::pair<uint64_t, std::string>> got;
+    uint64_t count = inflate::grep("inflate_test_copy.cpp.gz",
+            {"gunzip", "CHECK"}, [&](uint64_t offset, std::string_view line) {
+                got.push_back({offset, std::string(line)});
+            });
+    CHECK(count == want.size());
+    CHECK(got == want);
+
+    CHECK(inflate::grep("inflate_test_copy.cpp.gz", {"no such text"},
+                [](uint64_t, std::string_view) {}) == 0);
+
+    // matches in every member, at offsets into all of the data
+    temp_file twice(members(2));
+    auto first = want;
+    for (auto& match : first) {
+        want.push_back({match.first + expected.str().size(), match.second});
+    }
+    got.clear();
+    count = inflate::grep(twice.name(), {"gunzip", "CHECK"},
+            [&](uint64_t offset, std::string_view line) {
+                got.push_back({offset, std::string(line)});
+            });
+    CHECK(count == want.size());
+    CHECK(got == want);
+}
+
+TEST_CASE("checkpoints", "[igzstream][checkpoint][fullfiles][all]") {
+    std::ostringstream expected;
+    inflate::gunzip("inflate_test_copy.cpp.gz", expected);
+
+    // at every position, in chunks that stop in the middle of matches
+    for (size_t stop = 0; stop <= 7890; stop += 263) {
+        inflate::igzstream gz("inflate_test_copy.cpp.gz", 7);
+        std::string head(stop, '\0');
+        gz.read(&head[0], stop);
+        std::string blob = gz.checkpoint();
+
+        inflate::igzstream resumed("inflate_test_copy.cpp.gz", blob, 7);
+        std::string rest((std::istreambuf_iterator<char>(resumed)),
+                std::istreambuf_iterator<char>());
+        REQUIRE(head + rest == expected.str());
+        REQUIRE(!resumed.bad());
+    }
+
+    // a damaged window is copied from by later matches, and the crc
+    // catches it
+    inflate::igzstream gz("inflate_test_copy.cpp.gz", 16);
+    std::string head(4000, '\0');
+    gz.read(&head[0], 4000);
+    std::string blob = gz.checkpoint();
+    for (size_t i = blob.size() - 1000; i < blob.size(); i++) {
+        blob[i] ^= 0x55;
+    }
+    inflate::igzstream resumed("inflate_test_copy.cpp.gz", blob, 16);
+    std::string rest(4000, '\0');
+    resumed.read(&rest[0], 4000);
+    CHECK(resumed.bad());
+
+    CHECK_THROWS_AS(inflate::igzstream("inflate_test_copy.cpp.gz", "junk"),
+            const inflate::decode_error&);
 }
 
+TEST_CASE("error codes", "[errors][all]") {
+    std::ifstream deflated("inflate_test_copy.cpp.deflate",
+            std::ios::in|std::ios::binary);
+    std::string stream((std::istreambuf_iterator<char>(deflated)),
+            std::istreambuf_iterator<char>());
+    const char* fn = "inflate_test_corrupt.deflate";
+    auto decode = [fn](const std::string& contents, std::string& output) {
+        std::ofstream(fn, std::ios::out|std::ios::binary) << contents;
+        ifbstream in(fn);
+        ringbuffer buf(inflate::max_buffer_size);
+        inflate::inflater inf(in, buf);
+        std::vector<char> block(65536);
+        size_t count = inf.decode(block.data(), block.size());
+        output.assign(block.data(), count);
+        return inf.failure();
+    };
+    std::string expected, output;
+    REQUIRE(decode(stream, expected).code == inflate::error::none);
+
+    SECTION("truncated") {
+        inflate::status s = decode(stream.substr(0, 1000), output);
+        CHECK(s.code == inflate::error::truncated);
+        CHECK(s.bit_offset == 8000);
+        // everything before the end is decoded
+        CHECK(output.size() > 1000);
+        CHECK(output == expected.substr(0, output.size()));
+    }
+
+    SECTION("invalid block type") {
+        inflate::status s = decode("\x07", output);
+        CHECK(s.code == inflate::error::invalid_block_type);
+        CHECK(s.bit_offset == 3);
+    }
+
+    SECTION("distance too far") {
+        // fixed block: literal 'a', then length 3 distance 2
+        inflate::status s = decode(std::string("\x4b\x04\x42\x00", 4),
+                output);
+        CHECK(s.code == inflate::error::distance_too_far);
+        CHECK(output == "a");
+    }
+
+    SECTION("thrown by the wrappers") {
+        std::ofstream(fn, std::ios::out|std::ios::binary)
+            << stream.substr(0, 1000);
+        std::ostringstream out;
+        CHECK_THROWS_AS(inflate::inflate_raw(fn, out),
+                const std::ios_base::failure&);
+        std::ofstream(fn, std::ios::out|std::ios::binary) << "\x07";
+        CHECK_THROWS_AS(inflate::inflate_raw(fn, out),
+                const inflate::decode_error&);
+    }
+    std::remove(fn);
+}
+
+TEST_CASE("recovering damaged files", "[errors][fullfiles][all]") {
+    // dynamic blocks starting at bits 22840 and 30114, and bytes from
+    // 3647 damaged, which is noticed in a bad block type
+    std::ostringstream output;
+
+    SECTION("up to the damage") {
+        auto damages = inflate::gunzip_recover(
+                "inflate_test_damaged.gz", output);
+        REQUIRE(damages.size() == 1);
+        CHECK(damages[0].failure.code
+                == inflate::error::invalid_block_type);
+        CHECK(damages[0].failure.bit_offset == 29244);
+        CHECK(damages[0].output_offset == 9619);
+        CHECK(damages[0].resumed_at == 0);
+        CHECK(output.str().size() == 9619);
+    }
+
+    SECTION("resuming at the next block") {
+        auto damages = inflate::gunzip_recover(
+                "inflate_test_damaged.gz", output, true);
+        REQUIRE(damages.size() == 1);
+        CHECK(damages[0].resumed_at == 30114);
+        CHECK(output.str().size() == 24065);
+    }
+
+    SECTION("intact files") {
+        auto damages = inflate::gunzip_recover(
+                "inflate_test_copy.cpp.gz", output, true);
+        CHECK(damages.empty());
+        std::ostringstream expected;
+        inflate::gunzip("inflate_test_copy.cpp.gz", expected);
+        CHECK(output.str() == expected.str());
+    }
+
+    SECTION("every member") {
+        std::ostringstream one;
+        inflate::gunzip("inflate_test_copy.cpp.gz", one);
+        temp_file twice(members(2));
+        auto damages = inflate::gunzip_recover(twice.name(), output);
+        CHECK(damages.empty());
+        CHECK(output.str() == one.str() + one.str());
+
+        // a bad CRC-32 in the first member's trailer
+        std::string bytes = members(2);
+        size_t size = bytes.size() / 2;
+        bytes[size - 8] ^= 1;
+        temp_file bad(bytes);
+        output.str("");
+        damages = inflate::gunzip_recover(bad.name(), output);
+        REQUIRE(damages.size() == 1);
+        CHECK(damages[0].failure.code
+                == inflate::error::checksum_mismatch);
+        CHECK(damages[0].output_offset == 7890);
+        CHECK(damages[0].resumed_at == 8 * size);
+        CHECK(output.str() == one.str() + one.str());
+    }
+}
+
+TEST_CASE("verifying files", "[verify][fullfiles][all]") {
+    inflate::verification v = inflate::gunzip_verify(
+            "inflate_test_copy.cpp.gz");
+    CHECK_FALSE(v.status);
+    CHECK(v.members == 1);
+    CHECK(v.uncompressed_size == 7890);
+
+    v = inflate::gunzip_verify("inflate_test_damaged.gz");
+    CHECK(v.status.code == inflate::error::invalid_block_type);
+    CHECK(v.status.bit_offset == 29244);
+
+    CHECK(inflate::gunzip_verify("no_such_file.gz").status.code
+            == inflate::error::cannot_open);
+
+    // the same data with its CRC-32 changed, and twice over
+    std::string bad = members(1);
+    bad[bad.size() - 8] ^= 1;
+    temp_file twice(members(2));
+    v = inflate::gunzip_verify(twice.name());
+    CHECK_FALSE(v.status);
+    CHECK(v.members == 2);
+    CHECK(v.uncompressed_size == 2 * 7890);
+    // reading ahead in blocks far smaller than the file
+    v = inflate::gunzip_verify("teestream.h.gch.gz", 0, 4);
+    CHECK_FALSE(v.status);
+    CHECK(v.compressed_size == 2409511);
+
+    temp_file damaged(bad);
+    v = inflate::gunzip_verify(damaged.name());
+    CHECK(v.status.code == inflate::error::checksum_mismatch);
+    std::ostringstream output;
+    CHECK_THROWS_AS(inflate::gunzip(damaged.name(), output),
+            const inflate::decode_error&);
+}
+
+TEST_CASE("decoding within limits", "[limits][fullfiles][all]") {
+    // 2409511 bytes decoding to 17367504
+    const char* fn = "teestream.h.gch.gz";
+    inflate::verification v = inflate::gunzip_verify(fn, {0, 100, 1 << 30});
+    CHECK_FALSE(v.status);
+    CHECK(v.uncompressed_size == 17367504);
+
+    // stopped soon after, not at the end
+    v = inflate::gunzip_verify(fn, {1000000, 0, 0});
+    CHECK(v.status.code == inflate::error::output_limit);
+    CHECK(v.uncompressed_size > 1000000);
+    CHECK(v.uncompressed_size < 1000000 + 70000);
+    v = inflate::gunzip_verify(fn, {0, 2, 0});
+    CHECK(v.status.code == inflate::error::ratio_limit);
+    CHECK(v.uncompressed_size < 17367504);
+    v = inflate::gunzip_verify(fn, {0, 0, 10000});
+    CHECK(v.status.code == inflate::error::memory_limit);
+    CHECK(v.uncompressed_size == 0);
+
+    // over all the members of a file, not each one
+    temp_file twice(members(2));
+    CHECK_FALSE(inflate::gunzip_verify(twice.name(),
+                {2 * 7890, 0, 0}).status);
+    CHECK(inflate::gunzip_verify(twice.name(),
+                {7890 + 100, 0, 0}).status.code
+            == inflate::error::output_limit);
+
+    // memory checked along with the ratio, here as more input is fed
+    std::ifstream gz(fn, std::ios::binary);
+    std::string input((std::istreambuf_iterator<char>(gz)),
+            std::istreambuf_iterator<char>());
+    ifbstream fed;
+    std::memcpy(fed.reserve_input(65536), input.data(), 65536);
+    fed.commit_input(65536);
+    inflate::gzip_file file;
+    REQUIRE(inflate::_UTIL::read_gzip_header(fed, file)
+            == inflate::error::none);
+    ringbuffer window(inflate::max_buffer_size);
+    inflate::inflater inf(fed, window);
+    inf.set_limits({0, 100, inf.memory() + 100000});
+    inf.set_lookahead(20000);
+    std::vector<char> block(8192);
+    REQUIRE(inf.decode(block.data(), block.size()) == block.size());
+    size_t rest = input.size() - 65536;
+    std::memcpy(fed.reserve_input(rest), input.data() + 65536, rest);
+    fed.commit_input(rest);
+    inf.set_lookahead(0);
+    while (inf.decode(block.data(), block.size()) > 0) {}
+    CHECK(inf.failure().code == inflate::error::memory_limit);
+
+    std::ostringstream output;
+    try {
+        inflate::gunzip(fn, output, {500000, 0, 0});
+        FAIL("no exception");
+    }
+    catch (const inflate::decode_error& e) {
+        CHECK(e.where().code == inflate::error::output_limit);
+    }
+    CHECK(output.str().size() < 500000 + 70000);
+
+    CHECK_THROWS_AS(inflate::grep(fn, {"x"},
+                [](uint64_t, std::string_view) {}, {0, 0, 10000}),
+            const inflate::decode_error&);
+}
+
+TEST_CASE("caching decoders", "[cache][fullfiles][all]") {
+    SECTION("least recently used") {
+        inflate::decoder_cache cache(2);
+        uint8_t a[] = {1, 2, 3, 3, 1}, b[] = {2, 2, 2, 2, 1},
+                c[] = {1, 1, 1, 1, 1};
+        const inflate::Decoder *lit_a, *dist_a, *lit, *dist;
+        cache.get(a, 4, 1, lit_a, dist_a);
+        cache.get(b, 4, 1, lit, dist);
+        CHECK(lit != lit_a);
+        cache.get(a, 4, 1, lit, dist);
+        CHECK(lit == lit_a);
+        CHECK(dist == dist_a);
+        // the same lengths split differently are another header
+        cache.get(a, 3, 2, lit, dist);
+        CHECK(lit != lit_a);
+        CHECK(cache.hits() == 1);
+        CHECK(cache.misses() == 3);
+        // b made way for it, a was used since
+        cache.get(a, 4, 1, lit, dist);
+        CHECK(lit == lit_a);
+        cache.get(c, 2, 2, lit, dist);
+        CHECK(cache.misses() == 4);
+        inflate::Decoder built = *lit;
+        CHECK(built.str() == inflate::build_decoder({{1, 1}}).str());
+    }
+
+    SECTION("repeated members") {
+        temp_file thrice(members(3));
+        inflate::verification v = inflate::gunzip_verify(thrice.name());
+        CHECK(v.cache_hits + v.cache_misses == 0);
+        v = inflate::gunzip_verify(thrice.name(), 8);
+        CHECK_FALSE(v.status);
+        CHECK(v.members == 3);
+        CHECK(v.uncompressed_size == 3 * 7890);
+        CHECK(v.cache_misses > 0);
+        CHECK(v.cache_hits == 2 * v.cache_misses);
+    }
+}
+
+TEST_CASE("scanning members", "[scan][fullfiles][all]") {
+    size_t size = members(1).size();
+    temp_file twice(members(2));
+
+    auto found = inflate::scan(twice.name());
+    REQUIRE(found.size() == 2);
+    CHECK(found[0].offset == 0);
+    CHECK(found[0].end == size);
+    CHECK(found[1].offset == size);
+    CHECK(found[1].end == 2 * size);
+    for (auto& m : found) {
+        CHECK(m.size == 7890);
+        CHECK(m.isize == 7890);
+        CHECK(m.data_offset > m.offset);
+    }
+
+    CHECK(inflate::scan("teestream.h.gch.gz")[0].size == 17367504);
+    CHECK_THROWS(inflate::scan("inflate_test_copy.cpp.zz"));
+}
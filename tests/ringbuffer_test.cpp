@@ -3,17 +3,96 @@
 #include "catch.hpp"
 
 #include "../ringbuffer.h"
+#include "../matchcopy.h"
+#include "../cpudispatch.h"
 #include "../teestream.h"
 #include <iostream>
+#include <memory>
 
 TEST_CASE("readfrom", "[all]") {
     ringbuffer buf(10);
     teestream tee(buf, std::cout);
     tee << "87654321";
 
-    buf.flush();
+    tee.flush();
     std::cout << buf.readfrom(2,2);
     tee << "ba";
+    tee.flush();
     std::cout << buf.readfrom(8,4);
     std::cout << std::endl << buf.str() << std::endl;
 }
+
+TEST_CASE("buffered tee", "[all]") {
+    std::ostringstream a, b, c;
+    std::string expected;
+    {
+        teestream tee({&a, &b}, 16);
+        tee << "0123456789";        // buffered
+        REQUIRE(a.str().empty());
+        tee << "abcdefghij";        // does not fit, forwards the buffer
+        REQUIRE(a.str() == "0123456789");
+        tee.attach(c);              // forwards what is collected
+        tee.write(std::string(40, 'x').data(), 40);  // skips the buffer
+        tee.put('!');
+        expected = "0123456789abcdefghij" + std::string(40, 'x') + "!";
+    }
+    REQUIRE(a.str() == expected);
+    REQUIRE(b.str() == expected);
+    REQUIRE(c.str() == std::string(40, 'x') + "!");
+}
+
+TEST_CASE("match copy kernels", "[all]") {
+    typedef void (*Kernel)(char*, size_t, size_t);
+    std::vector<Kernel> kernels = {inflate::copy_match_scalar};
+#ifdef INFLATE_X86_DISPATCH
+    kernels.push_back(inflate::copy_match_sse2);
+    if (inflate::cpu_detected() >= inflate::cpu_tier::avx2) {
+        kernels.push_back(inflate::copy_match_avx2);
+    }
+#endif
+    std::string history = "abcdefghijklmnopqrstuvwxyz0123456789ABCDEFGH";
+    for (size_t distance = 1; distance <= history.size(); distance++) {
+        for (size_t length = 3; length <= 258; length++) {
+            std::string expected = history;
+            for (size_t i = 0; i < length; i++) {
+                expected += expected[expected.size() - distance];
+            }
+            for (Kernel kernel : kernels) {
+                std::vector<char> out(history.begin(), history.end());
+                out.resize(history.size() + length + inflate::match_slack);
+                kernel(out.data() + history.size(), distance, length);
+                REQUIRE(std::string(out.data(), expected.size())
+                        == expected);
+            }
+        }
+    }
+}
+
+TEST_CASE("matches from a dictionary", "[all]") {
+    auto dict = std::make_shared<const std::string>("0123456789abcdefXYZ");
+    ringbuffer buf(32768, dict);
+    // ending inside the dictionary, running from it into the stream
+    REQUIRE(std::string(buf.copy(7, 11), 7) == "89abcde");
+    REQUIRE(std::string(buf.copy(10, 10), 10) == "XYZ89abcde");
+    REQUIRE(buf.str() == "89abcdeXYZ89abcde");
+}
+
+TEST_CASE("sliding window", "[all]") {
+    ringbuffer buf(16);
+    std::string stream = "0123456789abcdef";
+    buf << stream;
+    for (int i = 1; i < 200000; i++) {  // slides many times over
+        if (i % 7 == 0) {
+            std::string match = buf.readfrom(10, 13);
+            REQUIRE(match == stream.substr(stream.size() - 13, 10));
+            stream += match;
+        }
+        else {
+            char c = 'a' + i % 26;
+            buf.put(c);
+            stream += c;
+        }
+    }
+    REQUIRE(buf.str() == stream.substr(stream.size() - 16));
+    REQUIRE_THROWS(buf.readfrom(3, 17) == "");
+}
@@ -0,0 +1,152 @@
+#define CATCH_CONFIG_MAIN
+#include "catch.hpp"
+
+#include "../untarstream.h"
+#include "../inflate.h"
+#include "../ifbstream.h"
+#include "../ringbuffer.h"
+#include "../matchcopy.h"
+#include "../huffmantree.h"
+#include "../adler32.h"
+#include "../crc32.h"
+#include "../decodeerror.h"
+#include "../inflater.h"
+
+#include <cstdlib>
+#include <sys/stat.h>
+#include <unistd.h>
+
+std::string slurp(const std::string& fn) {
+    std::ifstream in(fn, std::ios::binary);
+    std::ostringstream out;
+    out << in.rdbuf();
+    return out.str();
+}
+
+TEST_CASE("extracting tar.gz", "[untar][all]") {
+    std::ostringstream expected;
+    inflate::gunzip("inflate_test_copy.cpp.gz", expected);
+    std::string longname = "/deep/" + std::string(60, 'a') + '/'
+        + std::string(60, 'b') + "/long.txt";
+
+    for (std::string archive : {"untarstream_test_pax.tar.gz",
+                                "untarstream_test_gnu.tar.gz"}) {
+        char dir[] = "/tmp/untarstream_testXXXXXX";
+        REQUIRE(mkdtemp(dir) != nullptr);
+        std::string dest = dir;
+
+        INFO(archive);
+        inflate::untgz(archive, dest);
+        REQUIRE(slurp(dest + "/src/inflate_test.cpp") == expected.str());
+        REQUIRE(slurp(dest + "/src/link") == expected.str());
+        REQUIRE(slurp(dest + "/src/empty") == "");
+        REQUIRE(slurp(dest + longname) == "long name\nlong name\nlong name\n");
+
+        std::system(("rm -rf " + dest).c_str());
+    }
+}
+
+std::string tar_record(const std::string& name, char type,
+        const std::string& contents = "", const std::string& link = "") {
+    char record[512] = {};
+    std::strncpy(record, name.c_str(), 100);
+    std::memcpy(record + 100, "0000644", 7);
+    std::snprintf(record + 124, 12, "%011o", (unsigned)contents.size());
+    record[156] = type;
+    std::strncpy(record + 157, link.c_str(), 100);
+    std::memset(record + 148, ' ', 8);
+    unsigned int sum = 0;
+    for (unsigned char c : record) sum += c;
+    std::snprintf(record + 148, 8, "%06o", sum);
+    std::string padded = contents;
+    padded.resize((contents.size() + 511) / 512 * 512, '\0');
+    return std::string(record, sizeof(record)) + padded;
+}
+
+TEST_CASE("refusing to leave the destination", "[untar][all]") {
+    inflate::untarstream tar("/tmp");
+    std::string record = tar_record("../escape", '0');
+    tar.write(record.data(), record.size());
+    CHECK_THROWS(tar.close());
+}
+
+TEST_CASE("refusing huge extended headers", "[untar][all]") {
+    for (char type : {'L', 'K', 'x'}) {
+        inflate::untarstream tar("/tmp/untarstream_test_meta");
+        std::string record = tar_record("././@LongLink", type);
+        // claims 2G of long name, but is not read that far
+        std::snprintf(&record[124], 12, "%011o", 1u << 31);
+        std::memset(&record[148], ' ', 8);
+        unsigned int sum = 0;
+        for (int i = 0; i < 512; i++) sum += (unsigned char)record[i];
+        std::snprintf(&record[148], 8, "%06o", sum);
+        tar.write(record.data(), record.size());
+        tar.write(std::string(65536, 'a').data(), 65536);
+        CHECK_THROWS_WITH(tar.close(), "Extended header too large");
+    }
+    std::system("rm -rf /tmp/untarstream_test_meta");
+}
+
+TEST_CASE("refusing to extract through symlinks", "[untar][all]") {
+    char dir[] = "/tmp/untarstream_testXXXXXX";
+    REQUIRE(mkdtemp(dir) != nullptr);
+    std::string outside = std::string(dir) + "/outside";
+    REQUIRE(mkdir(outside.c_str(), 0777) == 0);
+    std::string victim = outside + "/victim.txt";
+    struct stat st;
+
+    SECTION("absolute symlink target") {
+        inflate::untarstream tar(std::string(dir) + "/dest");
+        std::string archive = tar_record("escape", '2', "", outside)
+            + tar_record("escape/victim.txt", '0', "owned\n");
+        tar.write(archive.data(), archive.size());
+        CHECK_THROWS(tar.close());
+    }
+
+    SECTION("symlink target climbing out") {
+        inflate::untarstream tar(std::string(dir) + "/dest");
+        std::string archive = tar_record("sub/escape", '2', "",
+                "../../outside") + tar_record("sub/escape/victim.txt", '0',
+                "owned\n");
+        tar.write(archive.data(), archive.size());
+        CHECK_THROWS(tar.close());
+    }
+
+    SECTION("symlink already in the destination") {
+        std::string dest = std::string(dir) + "/dest";
+        REQUIRE(mkdir(dest.c_str(), 0777) == 0);
+        REQUIRE(symlink(outside.c_str(), (dest + "/escape").c_str()) == 0);
+        inflate::untarstream tar(dest);
+        std::string archive = tar_record("escape/victim.txt", '0', "owned\n");
+        tar.write(archive.data(), archive.size());
+        CHECK_THROWS(tar.close());
+    }
+
+    SECTION("symlink in place of a file") {
+        std::string dest = std::string(dir) + "/dest";
+        REQUIRE(mkdir(dest.c_str(), 0777) == 0);
+        REQUIRE(symlink(victim.c_str(), (dest + "/file").c_str()) == 0);
+        inflate::untarstream tar(dest);
+        std::string archive = tar_record("file", '0', "mine\n")
+            + std::string(1024, '\0');
+        tar.write(archive.data(), archive.size());
+        tar.close();
+        REQUIRE(lstat((dest + "/file").c_str(), &st) == 0);
+        CHECK(S_ISREG(st.st_mode));
+        CHECK(slurp(dest + "/file") == "mine\n");
+    }
+
+    SECTION("symlinks staying inside") {
+        std::string dest = std::string(dir) + "/dest";
+        inflate::untarstream tar(dest);
+        std::string archive = tar_record("sub/file", '0', "inside\n")
+            + tar_record("sub/deeper/link", '2', "", "../file")
+            + std::string(1024, '\0');
+        tar.write(archive.data(), archive.size());
+        tar.close();
+        CHECK(slurp(dest + "/sub/deeper/link") == "inside\n");
+    }
+
+    CHECK(stat(victim.c_str(), &st) != 0);
+    std::system(("rm -rf " + std::string(dir)).c_str());
+}
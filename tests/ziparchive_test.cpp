@@ -0,0 +1,141 @@
+#define CATCH_CONFIG_MAIN
+#include "catch.hpp"
+
+#include "../ziparchive.h"
+#include "../inflate.h"
+#include "../ifbstream.h"
+#include "../ringbuffer.h"
+#include "../matchcopy.h"
+#include "../huffmantree.h"
+#include "../adler32.h"
+#include "../decodeerror.h"
+#include "../crc32.h"
+#include "../inflater.h"
+
+#include <cstdio>
+#include <fstream>
+#include <iterator>
+#include <map>
+#include <mutex>
+
+namespace {
+    // the archive with bytes at some offset replaced, the offset found
+    // from the nth (from 0) occurrence of a signature
+    std::string forged(const std::string& fn, const std::string& signature,
+            int nth, size_t at, const std::string& bytes) {
+        std::ifstream in(fn, std::ios::binary);
+        std::string zip((std::istreambuf_iterator<char>(in)),
+                std::istreambuf_iterator<char>());
+        size_t found = zip.find(signature);
+        while (nth-- > 0) found = zip.find(signature, found + 1);
+        zip.replace(found + at, bytes.size(), bytes);
+        std::string out = "/tmp/ziparchive_test_forged.zip";
+        std::ofstream(out, std::ios::binary) << zip;
+        return out;
+    }
+}
+
+TEST_CASE("central directory", "[zip][all]") {
+    inflate::ziparchive zip("ziparchive_test.zip");
+    auto& entries = zip.entries();
+
+    REQUIRE(entries.size() == 23);
+    REQUIRE(entries[0].name == "stored.txt");
+    REQUIRE(entries[0].method == 0);
+    REQUIRE(entries[0].uncompressed_size == 20);
+    REQUIRE(entries[1].name == "deflated.cpp");
+    REQUIRE(entries[1].method == 8);
+    REQUIRE(entries[1].uncompressed_size == 7890);
+    REQUIRE(entries[1].offset > entries[0].offset);
+}
+
+TEST_CASE("forged central directory sizes", "[zip][all]") {
+    // directory size, entry count, directory offset
+    for (auto field : {std::make_pair(12, std::string("\xff\xff\xff\x7f")),
+                       std::make_pair(10, std::string("\xff\xff")),
+                       std::make_pair(16, std::string("\xff\xff\xff\x7f"))}) {
+        std::string fn = forged("ziparchive_test.zip", "PK\x05\x06", 0,
+                field.first, field.second);
+        CHECK_THROWS_AS(inflate::ziparchive{fn},
+                const std::invalid_argument&);
+        std::remove(fn.c_str());
+    }
+}
+
+TEST_CASE("extracting entries", "[zip][all]") {
+    inflate::ziparchive zip("ziparchive_test.zip");
+    std::ostringstream expected;
+    inflate::gunzip("inflate_test_copy.cpp.gz", expected);
+
+    std::ostringstream stored, deflated;
+    zip.extract(zip.entries()[0], stored);
+    REQUIRE(stored.str() == "hello, stored world\n");
+    zip.extract(zip.entries()[1], deflated);
+    REQUIRE(deflated.str() == expected.str());
+
+    SECTION("in parallel") {
+        std::map<std::string, std::string> contents;
+        std::mutex lock;
+        zip.extract_all([&](const inflate::zipentry& entry,
+                    const std::string& data) {
+                std::lock_guard<std::mutex> guard(lock);
+                contents[entry.name] = data;
+            }, 4);
+        REQUIRE(contents.size() == 23);
+        REQUIRE(contents["deflated.cpp"] == expected.str());
+        REQUIRE(contents["dir/empty.txt"] == "");
+        for (int i = 0; i < 20; i++) {
+            std::string name = (i < 10 ? "many/0" : "many/")
+                + std::to_string(i) + ".txt";
+            REQUIRE(contents[name].size()
+                    == (100 * i + 1) * ("entry " + std::to_string(i) + " ").size());
+        }
+    }
+}
+
+TEST_CASE("bounded extraction", "[zip][all]") {
+    // deflated.cpp stating 100 bytes rather than 7890
+    std::string fn = forged("ziparchive_test.zip", "PK\x01\x02", 1, 24,
+            std::string("\x64\0\0\0", 4));
+    inflate::ziparchive bomb(fn);
+    REQUIRE(bomb.entries()[1].uncompressed_size == 100);
+    std::ostringstream out;
+    CHECK_THROWS_AS(bomb.extract(bomb.entries()[1], out),
+            const std::invalid_argument&);
+    CHECK(out.str().size() <= 100);
+    CHECK_THROWS_AS(bomb.extract_all(
+                [](const inflate::zipentry&, const std::string&) {}, 2),
+            const std::invalid_argument&);
+    std::remove(fn.c_str());
+
+    inflate::ziparchive zip("ziparchive_test.zip");
+    zip.set_limits({1000, 0, 0});
+    try {
+        zip.extract(zip.entries()[1], out);
+        FAIL("no exception");
+    }
+    catch (const inflate::decode_error& e) {
+        CHECK(e.where().code == inflate::error::output_limit);
+    }
+    std::ostringstream stored;
+    zip.extract(zip.entries()[0], stored);
+    CHECK(stored.str() == "hello, stored world\n");
+    zip.set_limits({10, 0, 0});
+    CHECK_THROWS_AS(zip.extract(zip.entries()[0], stored),
+            const inflate::decode_error&);
+}
+
+TEST_CASE("zip64", "[zip][all]") {
+    inflate::ziparchive zip("ziparchive_test64.zip");
+    auto& entries = zip.entries();
+
+    REQUIRE(entries.size() == 2);
+    REQUIRE(entries[0].uncompressed_size == 6000);
+    REQUIRE(entries[1].uncompressed_size == 7890);
+    REQUIRE(entries[1].offset > 0);
+
+    std::ostringstream a;
+    zip.extract(entries[0], a);
+    REQUIRE(a.str().size() == 6000);
+    REQUIRE(a.str().substr(0, 6) == "zip64 ");
+}
@@ -0,0 +1,427 @@
+#include "untarstream.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "inflate.h"
+
+
+namespace {
+    const size_t block_size = 1 << 18;  // batches writes to files
+    const uint64_t max_metadata = 1 << 20;  // long names and pax headers
+
+    std::string field(const char* record, int offset, int length) {
+        const char* s = record + offset;
+        return std::string(s, std::find(s, s + length, '\0'));
+    }
+
+    uint64_t number(const char* record, int offset, int length) {
+    /* Octal, or base-256 when the high bit is set (GNU, star) */
+        const unsigned char* s = (const unsigned char*)record + offset;
+        uint64_t value = 0;
+        if (s[0] & 0x80) {
+            value = s[0] & 0x7f;
+            for (int i = 1; i < length; i++) {
+                value = (value << 8) | s[i];
+            }
+            return value;
+        }
+        int i = 0;
+        while (i < length && s[i] == ' ') i++;
+        for (; i < length && s[i] >= '0' && s[i] <= '7'; i++) {
+            value = (value << 3) | (s[i] - '0');
+        }
+        return value;
+    }
+
+    bool checksum_valid(const char* record) {
+        const unsigned char* s = (const unsigned char*)record;
+        unsigned int sum = 0;
+        for (int i = 0; i < 512; i++) {
+            // the checksum field itself counts as spaces
+            sum += (i >= 148 && i < 156) ? ' ' : s[i];
+        }
+        return sum == number(record, 148, 8);
+    }
+
+    void makedirs(const std::string& path) {
+        for (size_t i = 1; i <= path.size(); i++) {
+            if (i == path.size() || path[i] == '/') {
+                std::string dir = path.substr(0, i);
+                if (mkdir(dir.c_str(), 0777) != 0 && errno != EEXIST) {
+                    throw std::runtime_error(
+                            "Cannot create directory " + dir);
+                }
+            }
+        }
+    }
+
+    bool climbs_out(const std::string& member, const std::string& link) {
+    /* Whether a relative symlink target, followed from the directory of
+     * the member, would go above the destination */
+        int depth = std::count(member.begin(), member.end(), '/');
+        size_t start = 0;
+        while (start < link.size()) {
+            size_t stop = link.find('/', start);
+            if (stop == std::string::npos) stop = link.size();
+            std::string part = link.substr(start, stop - start);
+            if (part == "..") {
+                if (--depth < 0) return true;
+            }
+            else if (!part.empty() && part != ".") {
+                depth++;
+            }
+            start = stop + 1;
+        }
+        return false;
+    }
+}
+
+
+inflate::untarbuf::untarbuf(std::string destdir)
+    : destdir(destdir)
+    , block(block_size)
+    , state(header)
+    , record_fill(0)
+    , zero_records(0)
+    , remaining(0)
+    , pad(0)
+    , fd(-1)
+    , dir(-1)
+    , metatype(0) {
+    setp(block.data(), block.data() + block.size());
+}
+
+inflate::untarbuf::~untarbuf() {
+    if (fd >= 0) ::close(fd);
+    if (dir >= 0) ::close(dir);
+}
+
+void inflate::untarbuf::close() {
+    sync();
+    if (state == failed) {
+        throw std::runtime_error(error);
+    }
+    if (state != end && (state != header || record_fill != 0)) {
+        throw std::runtime_error("Truncated tar archive");
+    }
+}
+
+int inflate::untarbuf::overflow(int c) {
+    sync();
+    if (c != EOF) {
+        *pptr() = (char)c;
+        pbump(1);
+    }
+    return state == failed ? EOF : (c == EOF ? !EOF : c);
+}
+
+int inflate::untarbuf::sync() {
+    consume(pbase(), pptr() - pbase());
+    setp(block.data(), block.data() + block.size());
+    return state == failed ? -1 : 0;
+}
+
+std::streamsize inflate::untarbuf::xsputn(const char* s, std::streamsize n) {
+    if ((size_t)n < block.size()) {
+        return std::streambuf::xsputn(s, n);
+    }
+    // large writes skip the put area
+    sync();
+    consume(s, n);
+    return n;
+}
+
+void inflate::untarbuf::fail(const std::string& message) {
+    if (fd >= 0) ::close(fd);
+    fd = -1;
+    error = message;
+    state = failed;
+}
+
+std::string inflate::untarbuf::path(const std::string& name) const {
+/* An archive member relative to destdir, refusing to leave it */
+    std::string clean;
+    size_t start = 0;
+    while (start < name.size()) {
+        size_t stop = name.find('/', start);
+        if (stop == std::string::npos) stop = name.size();
+        std::string part = name.substr(start, stop - start);
+        if (part == "..") {
+            throw std::runtime_error("Refusing to extract " + name);
+        }
+        if (!part.empty() && part != ".") {
+            if (!clean.empty()) clean += '/';
+            clean += part;
+        }
+        start = stop + 1;
+    }
+    if (clean.empty()) {
+        throw std::runtime_error("Empty member name");
+    }
+    return clean;
+}
+
+int inflate::untarbuf::parent(const std::string& member, std::string& leaf,
+        bool create) {
+/* Opens the directory a member goes in, one component at a time from
+ * destdir and never through a symlink, which an earlier member could have
+ * pointed anywhere. Returns a descriptor for the caller to close. */
+    if (dir < 0) {
+        makedirs(destdir);
+        dir = ::open(destdir.c_str(), O_RDONLY|O_DIRECTORY|O_CLOEXEC);
+        if (dir < 0) {
+            throw std::runtime_error("Cannot open directory " + destdir);
+        }
+    }
+    int at = ::dup(dir);
+    size_t start = 0;
+    size_t stop;
+    while (at >= 0 && (stop = member.find('/', start)) != std::string::npos) {
+        std::string part = member.substr(start, stop - start);
+        if (create && ::mkdirat(at, part.c_str(), 0777) != 0
+                && errno != EEXIST) {
+            ::close(at);
+            throw std::runtime_error("Cannot create directory "
+                    + destdir + '/' + member.substr(0, stop));
+        }
+        int next = ::openat(at, part.c_str(),
+                O_RDONLY|O_DIRECTORY|O_NOFOLLOW|O_CLOEXEC);
+        ::close(at);
+        if (next < 0) {
+            throw std::runtime_error("Refusing to extract " + member
+                    + " through " + member.substr(0, stop));
+        }
+        at = next;
+        start = stop + 1;
+    }
+    if (at < 0) {
+        throw std::runtime_error("Cannot open directory " + destdir);
+    }
+    leaf = member.substr(start);
+    return at;
+}
+
+void inflate::untarbuf::consume(const char* s, size_t n) {
+    while (n > 0) {
+        size_t count = 0;
+        switch (state) {
+            case header:
+                count = std::min(n, sizeof(record) - record_fill);
+                std::memcpy(record + record_fill, s, count);
+                record_fill += count;
+                if (record_fill == sizeof(record)) {
+                    record_fill = 0;
+                    try {
+                        begin_entry();
+                    }
+                    catch (std::exception& e) {
+                        fail(e.what());
+                    }
+                }
+                break;
+            case contents:
+                count = std::min<uint64_t>(n, remaining);
+                for (size_t done = 0; done < count; ) {
+                    ssize_t written = ::write(fd, s + done, count - done);
+                    if (written < 0 && errno != EINTR) {
+                        fail(std::string("Error writing file: ")
+                                + std::strerror(errno));
+                        return;
+                    }
+                    done += std::max<ssize_t>(written, 0);
+                }
+                remaining -= count;
+                if (remaining == 0) end_entry();
+                break;
+            case metadata:
+                count = std::min<uint64_t>(n, remaining);
+                meta.append(s, count);
+                remaining -= count;
+                if (remaining == 0) end_entry();
+                break;
+            case skip:
+                count = std::min<uint64_t>(n, remaining);
+                remaining -= count;
+                if (remaining == 0) end_entry();
+                break;
+            case padding:
+                count = std::min(n, pad);
+                pad -= count;
+                if (pad == 0) state = header;
+                break;
+            case end:
+            case failed:
+                return;  // trailing zeros, or nothing more to do
+        }
+        s += count;
+        n -= count;
+    }
+}
+
+void inflate::untarbuf::begin_entry() {
+    if (std::all_of(record, record + sizeof(record),
+                [](char c) { return c == 0; })) {
+        // the archive ends with two zero records
+        if (++zero_records == 2) state = end;
+        return;
+    }
+    zero_records = 0;
+    if (!checksum_valid(record)) {
+        throw std::runtime_error("Bad tar header checksum");
+    }
+
+    std::string name = field(record, 0, 100);
+    if (field(record, 257, 5) == "ustar" && record[345]) {
+        name = field(record, 345, 155) + '/' + name;
+    }
+    if (!longname.empty()) name = longname;
+    std::string link = longlink.empty() ? field(record, 157, 100) : longlink;
+    longname.clear();
+    longlink.clear();
+    char type = record[156];
+    remaining = number(record, 124, 12);
+    pad = (512 - remaining % 512) % 512;
+    state = skip;
+
+    switch (type) {
+        case 'L':  // GNU long name, long link name
+        case 'K':
+        case 'x':  // pax extended header for the next entry
+            // held whole, unlike contents, so only up to a point
+            if (remaining > max_metadata) {
+                throw std::runtime_error("Extended header too large");
+            }
+            metatype = type;
+            meta.clear();
+            state = metadata;
+            break;
+        case '5': {
+            std::string member = path(name);
+            std::string leaf;
+            int at = parent(member, leaf, true);
+            int made = ::mkdirat(at, leaf.c_str(), 0777);
+            ::close(at);
+            if (made != 0 && errno != EEXIST) {
+                throw std::runtime_error("Cannot create directory "
+                        + destdir + '/' + member);
+            }
+            break;
+        }
+        case '2': {
+            // links are made as they are, so only ones that stay inside
+            std::string member = path(name);
+            if (link.empty() || link[0] == '/' || climbs_out(member, link)) {
+                throw std::runtime_error("Refusing to link " + member
+                        + " to " + link);
+            }
+            std::string leaf;
+            int at = parent(member, leaf, true);
+            ::unlinkat(at, leaf.c_str(), 0);
+            int made = ::symlinkat(link.c_str(), at, leaf.c_str());
+            ::close(at);
+            if (made != 0) {
+                throw std::runtime_error("Cannot create symlink "
+                        + destdir + '/' + member);
+            }
+            break;
+        }
+        case '1': {
+            std::string member = path(name);
+            std::string source = path(link);
+            std::string leaf, source_leaf;
+            int source_at = parent(source, source_leaf, false);
+            int at;
+            try {
+                at = parent(member, leaf, true);
+            }
+            catch (...) {
+                ::close(source_at);
+                throw;
+            }
+            ::unlinkat(at, leaf.c_str(), 0);
+            int made = ::linkat(source_at, source_leaf.c_str(),
+                    at, leaf.c_str(), 0);
+            ::close(source_at);
+            ::close(at);
+            if (made != 0) {
+                throw std::runtime_error("Cannot create link "
+                        + destdir + '/' + member);
+            }
+            break;
+        }
+        case '0':
+        case '\0':
+        case '7': {
+            std::string member = path(name);
+            std::string leaf;
+            int at = parent(member, leaf, true);
+            mode_t mode = number(record, 100, 8) & 0777;
+            int flags = O_WRONLY|O_CREAT|O_TRUNC|O_NOFOLLOW|O_CLOEXEC;
+            fd = ::openat(at, leaf.c_str(), flags, mode);
+            if (fd < 0 && errno == ELOOP) {
+                // a symlink in its place is replaced, not written through
+                ::unlinkat(at, leaf.c_str(), 0);
+                fd = ::openat(at, leaf.c_str(), flags|O_EXCL, mode);
+            }
+            ::close(at);
+            if (fd < 0) {
+                throw std::runtime_error("Cannot create file "
+                        + destdir + '/' + member);
+            }
+            state = contents;
+            break;
+        }
+        default:  // devices, fifos and global headers are not extracted
+            break;
+    }
+    if (remaining == 0) end_entry();
+}
+
+void inflate::untarbuf::end_entry() {
+    if (fd >= 0) {
+        ::close(fd);
+        fd = -1;
+    }
+    if (state == metadata) {
+        if (metatype == 'L') {
+            longname = field(meta.data(), 0, meta.size());
+        }
+        else if (metatype == 'K') {
+            longlink = field(meta.data(), 0, meta.size());
+        }
+        else {
+            // records of "<length> <key>=<value>\n"
+            size_t start = 0;
+            while (start < meta.size()) {
+                size_t space = meta.find(' ', start);
+                if (space == std::string::npos) break;
+                size_t length = std::strtoul(meta.c_str() + start, nullptr, 10);
+                if (length == 0 || start + length > meta.size()) break;
+                std::string entry = meta.substr(space + 1,
+                        start + length - space - 2);
+                size_t equals = entry.find('=');
+                std::string key = entry.substr(0, equals);
+                if (equals != std::string::npos) {
+                    if (key == "path") longname = entry.substr(equals + 1);
+                    if (key == "linkpath") longlink = entry.substr(equals + 1);
+                }
+                start += length;
+            }
+        }
+    }
+    state = pad ? padding : header;
+}
+
+
+void inflate::untgz(std::string fn, std::string destdir/*="."*/) {
+    inflate::untarstream tar(destdir);
+    inflate::gunzip(fn, tar);
+    tar.close();
+}
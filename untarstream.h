@@ -0,0 +1,77 @@
+#ifndef UNTARSTREAM_H
+#define UNTARSTREAM_H
+
+#include <cstdint>
+#include <ostream>
+#include <streambuf>
+#include <string>
+#include <vector>
+
+namespace inflate {
+    class untarbuf;
+    class untarstream;
+
+    /* Extracts a gzipped tar archive into destdir, the decompressed
+     * archive is never held in memory or written anywhere but the
+     * extracted files */
+    void untgz(std::string fn, std::string destdir=".");
+}
+
+
+// Parses a tar archive (ustar, with GNU long names and pax paths) as it
+// is written, creating directories and links and writing file contents
+// straight from the put area to the destination files. Errors are kept
+// until close, as ostreams swallow exceptions thrown by their streambuf.
+class inflate::untarbuf : public std::streambuf {
+public:
+    untarbuf(std::string destdir);
+    ~untarbuf();
+
+    // flushes and reports the first error or a truncated archive
+    void close();
+
+private:
+    virtual int overflow(int c);
+    virtual int sync();
+    virtual std::streamsize xsputn(const char* s, std::streamsize n);
+
+    void consume(const char* s, size_t n);
+    void begin_entry();
+    void end_entry();
+    void fail(const std::string& message);
+    std::string path(const std::string& name) const;
+    int parent(const std::string& member, std::string& leaf, bool create);
+
+    enum mode {header, contents, metadata, skip, padding, end, failed};
+
+    std::string destdir;
+    std::vector<char> block;
+    mode state;
+    char record[512];
+    size_t record_fill;
+    int zero_records;
+    uint64_t remaining;
+    size_t pad;
+    int fd;
+    int dir;                     // destdir, once opened
+    char metatype;               // typeflag of a pending extended header
+    std::string meta;            // its contents
+    std::string longname;        // name for the next entry, if set
+    std::string longlink;        // link target for the next entry
+    std::string error;
+};
+
+
+class inflate::untarstream : public std::ostream {
+public:
+    untarstream(std::string destdir)
+        : std::ostream(&ubuf)
+        , ubuf(destdir) {}
+
+    inline void close() {flush(); ubuf.close();}
+
+private:
+    untarbuf ubuf;
+};
+
+#endif
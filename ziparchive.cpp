@@ -0,0 +1,326 @@
+#include "ziparchive.h"
+
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#include <fstream>
+#include <mutex>
+#include <stdexcept>
+#include <streambuf>
+
+#include "inflate.h"
+#include "inflater.h"
+#include "crc32.h"
+#include "teestream.h"
+
+
+namespace {
+    namespace signature {
+        const uint32_t local_header = 0x04034b50;
+        const uint32_t central_header = 0x02014b50;
+        const uint32_t end_of_directory = 0x06054b50;
+        const uint32_t zip64_end_of_directory = 0x06064b50;
+        const uint32_t zip64_locator = 0x07064b50;
+    }
+
+    const int window_size = 32768;
+    const uint16_t zip64_extra_id = 0x0001;
+    const uint16_t encrypted = 0x0001;  // general purpose flag bit 0
+
+    inline uint16_t le16(const unsigned char* p) {
+        return p[0] | (p[1] << 8);
+    }
+
+    inline uint32_t le32(const unsigned char* p) {
+        return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+    }
+
+    inline uint64_t le64(const unsigned char* p) {
+        return le32(p) | ((uint64_t)le32(p + 4) << 32);
+    }
+
+    inline uint32_t read32(ifbstream& in) {
+        uint32_t lo = in.read(16);
+        return lo | ((uint32_t)in.read(16) << 16);
+    }
+
+    // Appends to a string which keeps its capacity from entry to entry
+    class appendbuf : public std::streambuf {
+    public:
+        appendbuf(std::string& s) : s(s) {}
+    private:
+        virtual int overflow(int c) {
+            if (c != EOF) s.push_back((char)c);
+            return c == EOF ? !EOF : c;
+        }
+        virtual std::streamsize xsputn(const char* p, std::streamsize n) {
+            s.append(p, n);
+            return n;
+        }
+        std::string& s;
+    };
+
+    // Decoder state reused for every entry a thread extracts
+    struct extractor {
+        ifbstream in;
+        ringbuffer buf;
+        inflate::limits bounds;
+        std::string contents;
+        appendbuf contentsbuf;
+        std::ostream out;
+
+        extractor(const std::string& fn, const inflate::limits& bounds)
+            : in(fn)
+            , buf(window_size)
+            , bounds(bounds)
+            , contentsbuf(contents)
+            , out(&contentsbuf) {}
+
+        // decodes the entry to output, which is left to check its crc
+        void run(const inflate::zipentry& entry, std::ostream& output);
+        static void check(const inflate::zipentry& entry, uint32_t crc);
+    };
+}
+
+
+void extractor::run(const inflate::zipentry& entry, std::ostream& output) {
+    if (entry.flags & encrypted) {
+        throw std::invalid_argument("Encrypted entry: " + entry.name);
+    }
+
+    in.seekg(entry.offset);
+    if (read32(in) != signature::local_header) {
+        throw std::invalid_argument("Bad local header: " + entry.name);
+    }
+    in.seekg(entry.offset + 26);
+    int namelen = in.read(16);
+    int extralen = in.read(16);
+    uint64_t start = entry.offset + 30 + namelen + extralen;
+    in.seekg(start);
+
+    switch (entry.method) {
+        case 0: {
+            if (bounds.max_output
+                    && entry.compressed_size > bounds.max_output) {
+                inflate::raise({inflate::error::output_limit, start * 8});
+            }
+            char block[16384];
+            uint64_t left = entry.compressed_size;
+            while (left > 0) {
+                std::streamsize n = std::min<uint64_t>(left, sizeof(block));
+                in.read_bytes(block, n);
+                output.write(block, n);
+                left -= n;
+            }
+            break;
+        }
+        case 8: {
+            // a zip bomb's stated size is no bound on what it decodes to
+            buf.reset();
+            inflate::inflater inf(in, buf);
+            inf.set_limits(bounds, 0, start);
+            char block[16384];
+            uint64_t decoded = 0;
+            size_t count;
+            while ((count = inf.read(block, sizeof(block))) > 0) {
+                decoded += count;
+                if (bounds.max_output && decoded > bounds.max_output) {
+                    inflate::raise({inflate::error::output_limit,
+                            in.tellbit()});
+                }
+                if (decoded > entry.uncompressed_size) {
+                    throw std::invalid_argument(
+                            "Entry larger than its stated size: "
+                            + entry.name);
+                }
+                output.write(block, count);
+            }
+            break;
+        }
+        default:
+            throw std::invalid_argument("Unsupported compression method "
+                    + std::to_string(entry.method) + ": " + entry.name);
+    }
+}
+
+void extractor::check(const inflate::zipentry& entry, uint32_t crc) {
+    if (crc != entry.crc) {
+        throw std::invalid_argument("CRC-32 check failed: " + entry.name);
+    }
+}
+
+
+inflate::ziparchive::ziparchive(std::string fn)
+    : fn(fn)
+    , bounds{0, 0, 0} {
+    std::ifstream in;
+    in.exceptions(std::ios::badbit|std::ios::failbit);
+    in.open(fn, std::ios::in|std::ios::binary);
+
+    // the end of central directory record is at most 64K from the end
+    in.seekg(0, std::ios::end);
+    uint64_t filesize = in.tellg();
+    uint64_t tailsize = std::min<uint64_t>(filesize, 22 + 65535);
+    std::vector<unsigned char> tail(tailsize);
+    in.seekg(filesize - tailsize);
+    in.read((char*)tail.data(), tailsize);
+
+    long eocd = (long)tailsize - 22;
+    while (eocd >= 0 && le32(&tail[eocd]) != signature::end_of_directory) {
+        eocd--;
+    }
+    if (eocd < 0) {
+        throw std::invalid_argument("Not in zip format");
+    }
+    const unsigned char* end = &tail[eocd];
+    uint64_t count = le16(end + 10);
+    uint64_t dirsize = le32(end + 12);
+    uint64_t diroffset = le32(end + 16);
+
+    // ZIP64 archives have a locator pointing to a larger record
+    if (eocd >= 20 && le32(&tail[eocd - 20]) == signature::zip64_locator) {
+        unsigned char record[56];
+        in.seekg(le64(&tail[eocd - 20 + 8]));
+        in.read((char*)record, sizeof(record));
+        if (le32(record) != signature::zip64_end_of_directory) {
+            throw std::invalid_argument("Bad zip64 end of directory");
+        }
+        count = le64(record + 32);
+        dirsize = le64(record + 40);
+        diroffset = le64(record + 48);
+    }
+
+    // forged sizes would be allocated before any entry is looked at
+    if (diroffset > filesize || dirsize > filesize - diroffset
+            || count > dirsize / 46) {
+        throw std::invalid_argument("Bad central directory");
+    }
+    std::vector<unsigned char> dir(dirsize);
+    in.seekg(diroffset);
+    in.exceptions(std::ios::badbit);
+    in.read((char*)dir.data(), dirsize);
+    if ((uint64_t)in.gcount() != dirsize) {
+        throw std::invalid_argument("Bad central directory");
+    }
+
+    directory.reserve(count);
+    const unsigned char* p = dir.data();
+    const unsigned char* dirend = p + dirsize;
+    for (uint64_t i = 0; i < count; i++) {
+        if (dirend - p < 46 || le32(p) != signature::central_header) {
+            throw std::invalid_argument("Bad central directory");
+        }
+        int namelen = le16(p + 28);
+        int extralen = le16(p + 30);
+        int commentlen = le16(p + 32);
+        if (dirend - p < 46 + namelen + extralen + commentlen) {
+            throw std::invalid_argument("Bad central directory");
+        }
+
+        inflate::zipentry entry;
+        entry.flags = le16(p + 8);
+        entry.method = le16(p + 10);
+        entry.crc = le32(p + 16);
+        entry.compressed_size = le32(p + 20);
+        entry.uncompressed_size = le32(p + 24);
+        entry.offset = le32(p + 42);
+        entry.name.assign((const char*)p + 46, namelen);
+
+        // saturated fields are found in the zip64 extra field, in order
+        const unsigned char* extra = p + 46 + namelen;
+        const unsigned char* extraend = extra + extralen;
+        while (extraend - extra >= 4) {
+            uint16_t id = le16(extra);
+            uint16_t size = le16(extra + 2);
+            const unsigned char* field = extra + 4;
+            const unsigned char* fieldend = field + size;
+            if (fieldend > extraend) break;
+            if (id == zip64_extra_id) {
+                if (entry.uncompressed_size == 0xffffffff
+                        && fieldend - field >= 8) {
+                    entry.uncompressed_size = le64(field);
+                    field += 8;
+                }
+                if (entry.compressed_size == 0xffffffff
+                        && fieldend - field >= 8) {
+                    entry.compressed_size = le64(field);
+                    field += 8;
+                }
+                if (entry.offset == 0xffffffff && fieldend - field >= 8) {
+                    entry.offset = le64(field);
+                }
+            }
+            extra = fieldend;
+        }
+
+        directory.push_back(entry);
+        p += 46 + namelen + extralen + commentlen;
+    }
+}
+
+
+void inflate::ziparchive::extract(const zipentry& entry,
+        std::ostream& output/*=std::cout*/) const {
+    extractor ex(fn, bounds);
+    inflate::crc32stream crc;
+    teestream checked(output, crc);
+    ex.run(entry, checked);
+    checked.flush();
+    extractor::check(entry, crc.checksum());
+}
+
+
+void inflate::ziparchive::extract_all(Consumer consumer,
+        unsigned threads/*=hardware_concurrency()*/) const {
+    std::vector<const zipentry*> all;
+    all.reserve(directory.size());
+    for (auto& entry : directory) {
+        all.push_back(&entry);
+    }
+    extract(all, consumer, threads);
+}
+
+
+void inflate::ziparchive::extract(
+        const std::vector<const zipentry*>& entries,
+        Consumer consumer,
+        unsigned threads/*=hardware_concurrency()*/) const {
+    threads = std::max(1u, std::min<unsigned>(threads, entries.size()));
+    std::atomic<size_t> next(0);
+    std::exception_ptr error;
+    std::mutex error_lock;
+
+    // workers take the next entry until none are left
+    auto worker = [&]() {
+        try {
+            extractor ex(fn, bounds);
+            for (size_t i; (i = next++) < entries.size(); ) {
+                const zipentry& entry = *entries[i];
+                ex.contents.clear();
+                ex.contents.reserve(
+                        std::min<uint64_t>(entry.uncompressed_size, 1 << 26));
+                ex.run(entry, ex.out);
+                extractor::check(entry, inflate::crc32(0,
+                            ex.contents.data(), ex.contents.size()));
+                consumer(entry, ex.contents);
+            }
+        }
+        catch (...) {
+            std::lock_guard<std::mutex> lock(error_lock);
+            if (!error) error = std::current_exception();
+            next = entries.size();
+        }
+    };
+
+    std::vector<std::thread> pool;
+    for (unsigned t = 1; t < threads; t++) {
+        pool.emplace_back(worker);
+    }
+    worker();
+    for (auto& thread : pool) {
+        thread.join();
+    }
+    if (error) {
+        std::rethrow_exception(error);
+    }
+}
@@ -0,0 +1,66 @@
+#ifndef ZIPARCHIVE_H
+#define ZIPARCHIVE_H
+
+#include <cstdint>
+#include <functional>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "inflate.h"
+
+namespace inflate {
+    struct zipentry;
+    class ziparchive;
+}
+
+
+struct inflate::zipentry {
+    std::string name;
+    unsigned short flags;
+    unsigned short method;       // 0 stored, 8 deflated
+    uint32_t crc;
+    uint64_t compressed_size;
+    uint64_t uncompressed_size;
+    uint64_t offset;             // of the local file header
+};
+
+
+// Reads the central directory of a ZIP (or ZIP64) archive and extracts
+// stored and deflated entries through the raw deflate engine.
+class inflate::ziparchive {
+public:
+    typedef std::function<void(const zipentry&, const std::string&)>
+        Consumer;
+
+    ziparchive(std::string fn);
+
+    inline const std::vector<zipentry>& entries() const
+        {return directory;}
+
+    void extract(const zipentry& entry, std::ostream& output=std::cout) const;
+
+    /* Extracting an entry fails past bounds, with a decode_error, each
+     * entry counted on its own. Deflated entries decoding to more than
+     * their stated size fail whether there are bounds or not. */
+    inline void set_limits(const inflate::limits& bounds) noexcept
+        {this->bounds = bounds;}
+
+    /* Extracts entries on a pool of threads, each reusing one input stream,
+     * window and output buffer for all the entries it decodes. The consumer
+     * is called on the worker threads, the contents it is handed are only
+     * valid for the duration of the call. */
+    void extract_all(Consumer consumer,
+            unsigned threads=std::thread::hardware_concurrency()) const;
+    void extract(const std::vector<const zipentry*>& entries,
+            Consumer consumer,
+            unsigned threads=std::thread::hardware_concurrency()) const;
+
+private:
+    std::string fn;
+    std::vector<zipentry> directory;
+    inflate::limits bounds;
+};
+
+#endif